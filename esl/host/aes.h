@@ -0,0 +1,9 @@
+#ifndef AES_H
+#define AES_H
+
+#include <stdint.h>
+
+// AES-128 encryption of one block, what sd_ecb_block_encrypt provides on the device
+void aesEncryptBlock(const uint8_t key[16], const uint8_t in[16], uint8_t out[16]);
+
+#endif
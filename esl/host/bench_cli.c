@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "cdc_fake.h"
+#include "loop.h"
+#include "cli.h"
+
+#define BENCH_RUN_NS 500000000ULL
+
+// recorded sessions, one command line per text line
+#define BENCH_STREAM_MAX      16384
+#define BENCH_STREAM_LINE_MAX 512
+
+// lines sent back to back in burst mode: cli.c has eight line slots, one of them always
+// holds the line being edited
+#define BENCH_BURST_LINES 7
+
+typedef struct
+{
+    const char* name;
+    const char* line;
+    uint8_t     colors;     // color events each line must produce
+} BenchWorkload;
+
+static const BenchWorkload gWorkloads[] =
+{
+    {"rgb",     "rgb 12 34 56\r",           1},
+    {"hsv",     "hsv 200 100 50\r",         1},
+    {"chained", "rgb 1 2 3; hsv 4 5 6\r",   2},
+    {"power",   "power\r",                  0},
+    {"unknown", "frobnicate 1 2 3\r",       0},
+    // Home and End in both CSI and SS3 form, ctrl+right with parameters
+    {"edited",  "rgb 7 8 9\x1b[H\x1bOH\x1b[F\x1bOF\x1b[1;5C\r", 1},
+};
+
+static uint64_t gTxBytes;
+static uint32_t gColorEvents;
+
+static void benchSink(const uint8_t* data, size_t len)
+{
+    gTxBytes += len;
+}
+
+static void benchEvent(const Event* event)
+{
+    if(event->type == EventChangeColorRGB || event->type == EventChangeColorHSV)
+        ++gColorEvents;
+}
+
+// returns false if any line was lost on the way, judged by the color events it should produce
+static bool benchWorkload(const BenchWorkload* work, uint8_t burst)
+{
+    size_t   len    = strlen(work->line);
+    uint32_t lines  = 0;
+    uint64_t start  = hostNowNs();
+    uint64_t elapsed;
+
+    gTxBytes     = 0;
+    gColorEvents = 0;
+    do
+    {
+        for(uint8_t idx = 0; idx < burst; ++idx)
+            cdcFakeSend(work->line, len);
+        hostLoopDrain(benchEvent);
+        lines  += burst;
+        elapsed = hostNowNs() - start;
+    } while(elapsed < BENCH_RUN_NS);
+
+    printf("%-8s %6u %12.0f %10.2f %10.1f\n", work->name, burst, lines * 1e9 / elapsed,
+           elapsed / 1e3 / lines, (double)gTxBytes / lines);
+
+    if(gColorEvents != lines * work->colors)
+    {
+        printf("FAIL: %u color events for %u lines\n", gColorEvents, lines);
+        return false;
+    }
+    return true;
+}
+
+// replays a recorded session line by line until the run time is used up; the latency of a line
+// runs from its first byte sent until the main loop has nothing left to do for it
+static bool benchStream(const char* path)
+{
+    static char stream[BENCH_STREAM_MAX];
+
+    FILE* file = fopen(path, "rb");
+    if(file == NULL)
+    {
+        printf("FAIL: cannot open %s\n", path);
+        return false;
+    }
+    size_t size = fread(stream, 1, sizeof(stream), file);
+    fclose(file);
+
+    const char* name = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+    char        worst[BENCH_STREAM_LINE_MAX] = "";
+    uint64_t    worstNs = 0;
+    uint32_t    lines   = 0;
+    uint64_t    start   = hostNowNs();
+    uint64_t    elapsed;
+
+    do
+    {
+        for(size_t pos = 0; pos < size;)
+        {
+            char   line[BENCH_STREAM_LINE_MAX];
+            size_t len = strcspn(&stream[pos], "\n");
+            if(len + 1 >= sizeof(line) || pos + len >= size)
+                break;
+            memcpy(line, &stream[pos], len);
+            line[len++] = '\r';
+            pos        += len;
+
+            uint64_t sent = hostNowNs();
+            cdcFakeSend(line, len);
+            hostLoopDrain(benchEvent);
+            uint64_t latency = hostNowNs() - sent;
+
+            if(latency > worstNs)
+            {
+                worstNs = latency;
+                snprintf(worst, sizeof(worst), "%.*s", (int)(len - 1 < 40 ? len - 1 : 40), line);
+            }
+            ++lines;
+        }
+        elapsed = hostNowNs() - start;
+    } while(elapsed < BENCH_RUN_NS && lines > 0);
+
+    if(lines == 0)
+    {
+        printf("FAIL: %s holds no complete line\n", name);
+        return false;
+    }
+
+    printf("%-16s %8.0f %10.2f %10.2f  %s\n", name, lines * 1e9 / elapsed, elapsed / 1e3 / lines,
+           worstNs / 1e3, worst);
+    return true;
+}
+
+// every way an upload can end must bring the strip back: each session begins an upload and
+// leaves it through one of them, the last one by closing the port
+static bool benchFlashLoadEnds(void)
+{
+    static const char* const sessions[] =
+    {
+        "flash_load 1 abort\r",
+        "flash_load 1 commit 16 1\r",
+        "flash_load 1 commit 16 x\r",
+        "flash_load 1 0 zz\r",
+        "flash_load 1 0 00 00\r",
+        "flash_load 9 begin\r",
+        "flash_load 1 begin\r",
+        NULL
+    };
+    bool ok = true;
+
+    for(uint8_t idx = 0; idx < sizeof(sessions) / sizeof(sessions[0]); ++idx)
+    {
+        cdcFakeSend("flash_load 1 begin\r", strlen("flash_load 1 begin\r"));
+        hostLoopDrain(benchEvent);
+        if(sessions[idx] != NULL)
+            cdcFakeSend(sessions[idx], strlen(sessions[idx]));
+        else
+        {
+            cdcFakeClose();
+            cdcFakeOpen(benchSink);
+        }
+        hostLoopDrain(benchEvent);
+
+        // a second begin restarts the upload, the strip stays paused until it ends
+        bool expected = sessions[idx] != NULL && strcmp(sessions[idx], "flash_load 1 begin\r") == 0;
+        if(hostStripIsSuspended() != expected)
+        {
+            printf("FAIL: strip %s after begin, %s\n", expected ? "resumed" : "left paused",
+                   sessions[idx] != NULL ? sessions[idx] : "port closed");
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// pushes command lines through the USB handler and the main loop path of the real CLI, one
+// line at a time and in bursts that fill the line slots, then replays the recorded sessions
+// given as arguments
+int main(int argc, char** argv)
+{
+    bool ok = true;
+
+    cliSetup();
+    cdcFakeOpen(benchSink);
+
+    printf("%-8s %6s %12s %10s %10s\n", "command", "burst", "lines/s", "us/line", "tx B/line");
+    for(uint8_t idx = 0; idx < sizeof(gWorkloads) / sizeof(gWorkloads[0]); ++idx)
+    {
+        ok &= benchWorkload(&gWorkloads[idx], 1);
+        ok &= benchWorkload(&gWorkloads[idx], BENCH_BURST_LINES);
+    }
+
+    ok &= benchFlashLoadEnds();
+
+    if(argc > 1)
+        printf("\n%-16s %8s %10s %10s  %s\n", "stream", "lines/s", "us/line", "worst us", "worst line");
+    for(int arg = 1; arg < argc; ++arg)
+        ok &= benchStream(argv[arg]);
+
+    cdcFakeClose();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "crc16.h"
+
+#include "host.h"
+#include "cdc_fake.h"
+#include "loop.h"
+#include "cli.h"
+#include "frame.h"
+#include "cobs.h"
+
+#define BENCH_RUN_NS 500000000ULL
+#define BENCH_FRAME_MAX 256
+
+typedef struct
+{
+    const char* name;
+    uint8_t     op;
+    uint8_t     len;
+} BenchWorkload;
+
+// SetPixels carries the most pixels a frame payload allows
+static const BenchWorkload gWorkloads[] =
+{
+    {"set_rgb",    FrameOpSetRGB,    3},
+    {"state",      FrameOpState,     0},
+    {"telemetry",  FrameOpTelemetry, 0},
+    {"set_pixels", FrameOpSetPixels, 2 + 82 * 3},
+};
+
+static uint8_t  gResp[BENCH_FRAME_MAX];
+static uint16_t gRespLen;
+static bool     gRespDone;
+static uint8_t  gRespSeq;
+static uint8_t  gRespStatus;
+static uint32_t gColorEvents;
+
+// collects the response frame the way a host reads it, up to the delimiter
+static void benchSink(const uint8_t* data, size_t len)
+{
+    for(size_t idx = 0; idx < len; ++idx)
+    {
+        if(data[idx] != 0)
+        {
+            if(gRespLen < BENCH_FRAME_MAX)
+                gResp[gRespLen++] = data[idx];
+            continue;
+        }
+
+        size_t size = cobsDecode(gResp, gRespLen);
+        gRespLen = 0;
+        if(size < 5 || crc16_compute(gResp, size - 2, NULL) != (gResp[size - 2] | (gResp[size - 1] << 8)))
+            continue;
+        gRespSeq    = gResp[0];
+        gRespStatus = gResp[2];
+        gRespDone   = true;
+    }
+}
+
+static void benchEvent(const Event* event)
+{
+    if(event->type == EventChangeColorRGB)
+        ++gColorEvents;
+}
+
+static size_t benchEncode(uint8_t* dst, uint8_t seq, uint8_t op, const uint8_t* payload, uint8_t len)
+{
+    uint8_t frame[BENCH_FRAME_MAX];
+    frame[0] = seq;
+    frame[1] = op;
+    memcpy(&frame[2], payload, len);
+
+    uint16_t crc = crc16_compute(frame, 2 + len, NULL);
+    frame[2 + len] = crc & 0xFF;
+    frame[3 + len] = crc >> 8;
+    return cobsEncode(dst, frame, 4 + len);
+}
+
+// one request at a time: the round trip runs from the first byte sent until the host holds
+// the whole response, including the main loop work the request queued
+static bool benchWorkload(const BenchWorkload* work)
+{
+    uint8_t  payload[FRAME_PAYLOAD_MAX] = {0};
+    uint8_t  tx[COBS_ENCODED_MAX(BENCH_FRAME_MAX)];
+    uint32_t cmds  = 0;
+    uint64_t rttMax = 0;
+    uint64_t start = hostNowNs();
+    uint64_t elapsed;
+
+    do
+    {
+        uint8_t seq = cmds;
+        payload[0]  = seq;
+        size_t len  = benchEncode(tx, seq, work->op, payload, work->len);
+
+        uint64_t sent = hostNowNs();
+        gRespDone = false;
+        cdcFakeSend(tx, len);
+        hostLoopDrain(benchEvent);
+        uint64_t rtt = hostNowNs() - sent;
+
+        if(!gRespDone || gRespSeq != seq || gRespStatus != FrameStatusSuccess)
+        {
+            printf("FAIL: %s seq %u answered %s, status %u\n", work->name, seq,
+                   gRespDone ? "" : "never", gRespStatus);
+            return false;
+        }
+        if(rtt > rttMax)
+            rttMax = rtt;
+        ++cmds;
+        elapsed = hostNowNs() - start;
+    } while(elapsed < BENCH_RUN_NS);
+
+    printf("%-10s %5u %12.0f %10.2f %10.2f\n", work->name, work->len, cmds * 1e9 / elapsed,
+           elapsed / 1e3 / cmds, rttMax / 1e3);
+    return true;
+}
+
+// the text frame hands the port back mid-transfer, the line behind it must reach the text CLI
+static bool benchHandoff(void)
+{
+    uint8_t tx[32];
+    size_t  len = benchEncode(tx, 0, FrameOpText, NULL, 0);
+    memcpy(&tx[len], "rgb 1 2 3\r", 10);
+
+    gColorEvents = 0;
+    cdcFakeSend(tx, len + 10);
+    hostLoopDrain(benchEvent);
+
+    if(gColorEvents != 1)
+    {
+        printf("FAIL: text after the mode switch produced %u color events\n", gColorEvents);
+        return false;
+    }
+    return true;
+}
+
+// loopback of the binary protocol through the fake CDC port and the real frame and CLI code
+int main(void)
+{
+    bool ok = true;
+
+    cliSetup();
+    cdcFakeOpen(benchSink);
+    cdcFakeSend("binary\r", 7);
+    hostLoopDrain(NULL);
+    gRespLen = 0;
+
+    printf("%-10s %5s %12s %10s %10s\n", "frame", "bytes", "cmds/s", "us/cmd", "max us");
+    for(uint8_t idx = 0; idx < sizeof(gWorkloads) / sizeof(gWorkloads[0]); ++idx)
+        ok &= benchWorkload(&gWorkloads[idx]);
+    ok &= benchHandoff();
+
+    cdcFakeClose();
+    return ok ? 0 : 1;
+}
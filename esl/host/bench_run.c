@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+// host runner of the bench registry: the same cases as the CLI "bench" command minus the
+// device-only ones, timed in nanoseconds of the monotonic clock; takes a case name and repeats
+int main(int argc, char** argv)
+{
+    uint8_t first   = 0;
+    uint8_t last    = benchGetNum();
+    uint8_t repeats = argc > 2 ? atoi(argv[2]) : BENCH_REPEATS_MAX;
+
+    if(argc > 1)
+    {
+        first = benchFind(argv[1]);
+        if(first == benchGetNum())
+        {
+            printf("FAIL: there is no benchmark named %s\n", argv[1]);
+            return 1;
+        }
+        last = first + 1;
+    }
+
+    printf("%-16s %8s %8s %8s\n", "case", "min ns", "median", "max");
+    for(uint8_t idx = first; idx < last; ++idx)
+    {
+        BenchResult result;
+        benchRun(idx, repeats, &result);
+        printf("%-16s %8u %8u %8u\n", benchGetName(idx), result.min, result.median, result.max);
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host.h"
+#include "ws2812.h"
+#include "power.h"
+
+// same chunking as the device, see STRIP_CHUNK_PIXELS in strip.c
+#define BENCH_CHUNK_PIXELS 32
+#define BENCH_CHUNK_SLOTS  (BENCH_CHUNK_PIXELS * WS2812_BITS_PER_PIXEL)
+#define BENCH_PIXEL_MAX    1000
+#define BENCH_RUN_NS       1000000000ULL
+
+static ColorRGB gFrame[BENCH_PIXEL_MAX];
+static uint16_t gChunks[2][BENCH_CHUNK_SLOTS];
+
+// read back after every frame so the encoding cannot be optimized away
+static volatile uint16_t gSink;
+
+// encodes a whole frame chunk by chunk into alternating halves, as the PWM handler does
+static void benchEncodeFrame(uint16_t num, uint16_t scale)
+{
+    for(uint16_t pixel = 0, chunk = 0; pixel < num; pixel += BENCH_CHUNK_PIXELS, chunk ^= 1)
+    {
+        uint16_t  cnt = num - pixel < BENCH_CHUNK_PIXELS ? num - pixel : BENCH_CHUNK_PIXELS;
+        uint16_t* end = ws2812EncodePixels(gChunks[chunk], &gFrame[pixel], cnt, scale);
+        ws2812EncodeIdle(end, gChunks[chunk] + BENCH_CHUNK_SLOTS);
+        gSink = gChunks[chunk][0];
+    }
+}
+
+// reports the encoder rate next to the rate the wire allows (1.25us per bit plus the latch)
+int main(void)
+{
+    static const uint16_t sizes[] = {60, 300, 1000};
+
+    srand(1);
+    for(uint16_t idx = 0; idx < BENCH_PIXEL_MAX; ++idx)
+        gFrame[idx] = (ColorRGB){.r = rand(), .g = rand(), .b = rand()};
+
+    printf("%6s %12s %10s %12s\n", "pixels", "encode fps", "us/frame", "wire fps");
+    for(uint8_t idx = 0; idx < sizeof(sizes) / sizeof(sizes[0]); ++idx)
+    {
+        uint16_t num    = sizes[idx];
+        uint32_t frames = 0;
+        uint64_t start  = hostNowNs();
+        uint64_t elapsed;
+        do
+        {
+            benchEncodeFrame(num, POWER_SCALE_UNITY - frames % 64);
+            ++frames;
+            elapsed = hostNowNs() - start;
+        } while(elapsed < BENCH_RUN_NS);
+
+        double wireUs = num * WS2812_BITS_PER_PIXEL * 1.25 + WS2812_RESET_SLOTS * 1.25;
+        printf("%6u %12.0f %10.2f %12.0f\n", num, frames * 1e9 / elapsed, elapsed / 1e3 / frames, 1e6 / wireUs);
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <string.h>
+
+#include "app_usbd_cdc_acm.h"
+#include "nrf_drv_usbd.h"
+
+#include "cdc_fake.h"
+
+static const app_usbd_cdc_acm_t* gCdc = NULL;
+static CdcFakeSink               gSink = NULL;
+
+static void*  gRxBuf  = NULL;
+static size_t gRxLen  = 0;
+static size_t gRxSize = 0;
+static bool   gTxBusy = false;
+
+app_usbd_class_inst_t const* app_usbd_cdc_acm_class_inst_get(app_usbd_cdc_acm_t const* p_cdc_acm)
+{
+    return (app_usbd_class_inst_t const*)p_cdc_acm;
+}
+
+ret_code_t app_usbd_class_append(app_usbd_class_inst_t const* p_cinst)
+{
+    gCdc = (const app_usbd_cdc_acm_t*)p_cinst;
+    return NRF_SUCCESS;
+}
+
+// nothing is ever buffered by the fake class, every read waits for the next packet
+ret_code_t app_usbd_cdc_acm_read_any(app_usbd_cdc_acm_t const* p_cdc_acm, void* p_buf, size_t length)
+{
+    gRxBuf = p_buf;
+    gRxLen = length;
+    return NRF_ERROR_IO_PENDING;
+}
+
+size_t app_usbd_cdc_acm_rx_size(app_usbd_cdc_acm_t const* p_cdc_acm)
+{
+    return gRxSize;
+}
+
+ret_code_t app_usbd_cdc_acm_write(app_usbd_cdc_acm_t const* p_cdc_acm, const void* p_buf, size_t length)
+{
+    if(gTxBusy)
+        return NRF_ERROR_BUSY;
+
+    gTxBusy = true;
+    if(gSink != NULL)
+        gSink(p_buf, length);
+    return NRF_SUCCESS;
+}
+
+void cdcFakeOpen(CdcFakeSink sink)
+{
+    gSink   = sink;
+    gTxBusy = false;
+    gCdc->handler(app_usbd_cdc_acm_class_inst_get(gCdc), APP_USBD_CDC_ACM_USER_EVT_PORT_OPEN);
+}
+
+void cdcFakeClose(void)
+{
+    gRxBuf  = NULL;
+    gTxBusy = false;
+    gCdc->handler(app_usbd_cdc_acm_class_inst_get(gCdc), APP_USBD_CDC_ACM_USER_EVT_PORT_CLOSE);
+}
+
+size_t cdcFakeSend(const void* data, size_t len)
+{
+    size_t sent = 0;
+
+    while(sent < len && gRxBuf != NULL)
+    {
+        size_t size = len - sent;
+        if(size > gRxLen)
+            size = gRxLen;
+        if(size > NRF_DRV_USBD_EPSIZE)
+            size = NRF_DRV_USBD_EPSIZE;
+
+        memcpy(gRxBuf, (const uint8_t*)data + sent, size);
+        gRxBuf  = NULL;
+        gRxSize = size;
+        sent   += size;
+        gCdc->handler(app_usbd_cdc_acm_class_inst_get(gCdc), APP_USBD_CDC_ACM_USER_EVT_RX_DONE);
+    }
+
+    return sent;
+}
+
+bool cdcFakePoll(void)
+{
+    if(!gTxBusy)
+        return false;
+
+    gTxBusy = false;
+    gCdc->handler(app_usbd_cdc_acm_class_inst_get(gCdc), APP_USBD_CDC_ACM_USER_EVT_TX_DONE);
+    return true;
+}
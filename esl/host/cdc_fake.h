@@ -0,0 +1,22 @@
+#ifndef CDC_FAKE_H
+#define CDC_FAKE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// host end of the fake CDC ACM port behind app_usbd_cdc_acm.h; the class handler is called
+// directly, one RX_DONE per full-speed packet and one TX_DONE per write the host has read
+typedef void (*CdcFakeSink)(const uint8_t* data, size_t len);
+
+void cdcFakeOpen(CdcFakeSink sink);
+
+void cdcFakeClose(void);
+
+// delivers host-to-device bytes in packets of at most 64 bytes, returns the bytes taken
+size_t cdcFakeSend(const void* data, size_t len);
+
+// reads the device write in flight and reports its completion, returns false if there was none
+bool cdcFakePoll(void);
+
+#endif
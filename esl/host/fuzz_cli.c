@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "host.h"
+#include "cdc_fake.h"
+#include "loop.h"
+#include "cli.h"
+#include "parse.h"
+
+#define FUZZ_LINE_MAX 256
+#define FUZZ_INPUT_MAX 1024
+#define FUZZ_RUNS     200000
+
+#define FUZZ_CHECK(cond)                                                        \
+    do                                                                          \
+    {                                                                           \
+        if(!(cond))                                                             \
+        {                                                                       \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            abort();                                                            \
+        }                                                                       \
+    } while(0)
+
+static bool gFuzzOpen = false;
+
+static void fuzzSink(const uint8_t* data, size_t len)
+{
+}
+
+// a number is accepted exactly when it is plain decimal and within max
+static void fuzzNumber(const char* token, uint32_t max)
+{
+    uint32_t value;
+    bool     ok     = parseNumber(token, max, &value);
+    bool     digits = *token != '\0' && strspn(token, "0123456789") == strlen(token);
+
+    errno = 0;
+    unsigned long long ref = digits ? strtoull(token, NULL, 10) : 0;
+    bool fits = digits && errno == 0 && ref <= max;
+
+    FUZZ_CHECK(ok == fits);
+    FUZZ_CHECK(!ok || value == ref);
+}
+
+// tokens are non-empty spans without spaces, NUL-terminated in place
+static void fuzzTokenize(const uint8_t* data, size_t size)
+{
+    char   line[FUZZ_LINE_MAX];
+    size_t len = size < FUZZ_LINE_MAX - 1 ? size : FUZZ_LINE_MAX - 1;
+    memcpy(line, data, len);
+    line[len] = '\0';
+    len = strlen(line);
+
+    ParseArgs args;
+    if(!parseTokenize(&args, line))
+        return;
+
+    uint32_t max = size > 0 ? (uint32_t)data[0] << (data[size - 1] % 25) : 0;
+    for(uint8_t idx = 0; idx < args.num; ++idx)
+    {
+        const char* token = parseArg(&args, idx);
+        FUZZ_CHECK(args.tokens[idx].length > 0);
+        FUZZ_CHECK(args.tokens[idx].offset + args.tokens[idx].length <= len);
+        FUZZ_CHECK(strlen(token) == args.tokens[idx].length);
+        FUZZ_CHECK(strchr(token, ' ') == NULL);
+
+        fuzzNumber(token, max);
+        fuzzNumber(token, UINT32_MAX);
+
+        uint8_t hex[FUZZ_LINE_MAX / 2];
+        parseHex(hex, token, args.tokens[idx].length);
+    }
+}
+
+// one input is one session on the port: sent through the CLI in packets from text mode, where
+// it may switch to binary frames and back, then handed to the tokenizer directly
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if(!gFuzzOpen)
+    {
+        cliSetup();
+        cdcFakeOpen(fuzzSink);
+        gFuzzOpen = true;
+    }
+
+    cliSetMode(CliModeText);
+    cdcFakeSend(data, size);
+    hostLoopDrain(NULL);
+
+    fuzzTokenize(data, size);
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+static const char* const gFuzzSeeds[] =
+{
+    "rgb 12 34 56\r",
+    "hsv 4294967295 1 2\r",
+    "color_add_rgb 1 2 3 teal\rcolor_set teal\r",
+    "macro_add m rgb 1 2 3 delay 100 hsv 4 5 6\rmacro m 0\rmacro_stop\r",
+    "flash_load 1 begin\rflash_load 1 0 00ff0000\rflash_load 1 commit 4 1234\r",
+    "pow\t\r\x1b[D\x1b[C\x1bOH\x1bOF\x7f\x7f\r\x1b[A\r",
+    "binary\r\x02\x01\x01\x01\x02\x03\x02\x02\x00\x03\x01\x7f\x01\x01\x00rgb 1 2 3\r",
+    "anim rainbow 1000; anim_stats; power; cli_stats\r\n",
+};
+
+static uint32_t gFuzzRand = 2463534242u;
+
+static uint32_t fuzzRand(void)
+{
+    gFuzzRand ^= gFuzzRand << 13;
+    gFuzzRand ^= gFuzzRand >> 17;
+    gFuzzRand ^= gFuzzRand << 5;
+    return gFuzzRand;
+}
+
+// bytes the CLI treats specially are picked more often than the rest
+static uint8_t fuzzByte(void)
+{
+    static const char special[] = "\r\n \t;\x1b[O~\x7f\b0123456789";
+    return fuzzRand() % 2 ? special[fuzzRand() % (sizeof(special) - 1)] : (uint8_t)fuzzRand();
+}
+
+static size_t fuzzMutate(uint8_t* buf, size_t len)
+{
+    uint8_t num = 1 + fuzzRand() % 8;
+    for(uint8_t cnt = 0; cnt < num; ++cnt)
+    {
+        size_t pos = len > 0 ? fuzzRand() % len : 0;
+        switch(fuzzRand() % 5)
+        {
+        case 0:
+            if(len > 0)
+                buf[pos] = fuzzByte();
+            break;
+
+        case 1:
+            if(len < FUZZ_INPUT_MAX)
+            {
+                memmove(&buf[pos + 1], &buf[pos], len - pos);
+                buf[pos] = fuzzByte();
+                ++len;
+            }
+            break;
+
+        case 2:
+            if(len > 0)
+            {
+                memmove(&buf[pos], &buf[pos + 1], len - pos - 1);
+                --len;
+            }
+            break;
+
+        // splices in another seed or repeats a chunk, which grows lines past their limits
+        case 3:
+        {
+            const char* seed = gFuzzSeeds[fuzzRand() % (sizeof(gFuzzSeeds) / sizeof(gFuzzSeeds[0]))];
+            size_t      add  = strlen(seed);
+            if(len + add <= FUZZ_INPUT_MAX)
+            {
+                memmove(&buf[pos + add], &buf[pos], len - pos);
+                memcpy(&buf[pos], seed, add);
+                len += add;
+            }
+            break;
+        }
+
+        default:
+        {
+            size_t add = len - pos < 64 ? len - pos : 64;
+            if(len + add <= FUZZ_INPUT_MAX)
+            {
+                memmove(&buf[pos + add], &buf[pos], len - pos);
+                len += add;
+            }
+            break;
+        }
+        }
+    }
+    return len;
+}
+
+// standalone driver for builds without libFuzzer: random mutations of the seeds above,
+// deterministic for a given run count (first argument)
+int main(int argc, char** argv)
+{
+    uint32_t runs  = argc > 1 ? strtoul(argv[1], NULL, 10) : FUZZ_RUNS;
+    uint64_t start = hostNowNs();
+
+    for(uint32_t run = 0; run < runs; ++run)
+    {
+        static uint8_t buf[FUZZ_INPUT_MAX];
+        const char*    seed = gFuzzSeeds[run % (sizeof(gFuzzSeeds) / sizeof(gFuzzSeeds[0]))];
+        size_t         len  = strlen(seed);
+
+        memcpy(buf, seed, len);
+        len = fuzzMutate(buf, len);
+        LLVMFuzzerTestOneInput(buf, len);
+    }
+
+    printf("%u inputs in %.2f s, no check failed\n", runs, (hostNowNs() - start) / 1e9);
+    return 0;
+}
+
+#endif
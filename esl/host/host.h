@@ -0,0 +1,19 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+// monotonic clock shared by the host harnesses
+static inline uint64_t hostNowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// strip state of the stubs, suspended between stripSuspend() and stripResume()
+bool hostStripIsSuspended(void);
+
+#endif
@@ -0,0 +1,34 @@
+#include "cdc_fake.h"
+#include "cli.h"
+#include "frame.h"
+
+#include "loop.h"
+
+void hostLoopDrain(HostLoopHandler handler)
+{
+    for(;;)
+    {
+        bool  busy  = cdcFakePoll();
+        Event event = queueEventDequeue();
+        switch(event.type)
+        {
+        case EventNone:
+            if(!busy)
+                return;
+            break;
+
+        case EventCliLine:
+            cliExecLines();
+            break;
+
+        case EventStripPixels:
+            frameApplyPixels();
+            break;
+
+        default:
+            if(handler != NULL)
+                handler(&event);
+            break;
+        }
+    }
+}
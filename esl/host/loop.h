@@ -0,0 +1,13 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "queue.h"
+
+typedef void (*HostLoopHandler)(const Event* event);
+
+// stands in for the main loop of main.c: the host reads every device write and queued events
+// are served until nothing is left in flight; CLI and frame events run the real handlers,
+// the rest goes to handler
+void hostLoopDrain(HostLoopHandler handler);
+
+#endif
@@ -0,0 +1,19 @@
+#include "host.h"
+
+#include "prof.h"
+
+// host build of the profiler: "cycles" are nanoseconds of the monotonic clock, the truncated
+// counter wraps every ~4.3s and differences of two samples stay valid across a single wrap
+void profSetup(void)
+{
+}
+
+uint32_t profCycles(void)
+{
+    return (uint32_t)hostNowNs();
+}
+
+uint32_t profCyclesToUs(uint32_t cycles)
+{
+    return cycles / 1000;
+}
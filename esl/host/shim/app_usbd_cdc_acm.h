@@ -0,0 +1,49 @@
+#ifndef APP_USBD_CDC_ACM_H
+#define APP_USBD_CDC_ACM_H
+
+#include <stddef.h>
+
+#include "sdk_errors.h"
+
+// fake CDC ACM class: the harness feeds host-to-device bytes and collects device-to-host writes,
+// see cdc_fake.h
+typedef enum
+{
+    APP_USBD_CDC_ACM_USER_EVT_RX_DONE,
+    APP_USBD_CDC_ACM_USER_EVT_TX_DONE,
+    APP_USBD_CDC_ACM_USER_EVT_PORT_OPEN,
+    APP_USBD_CDC_ACM_USER_EVT_PORT_CLOSE
+} app_usbd_cdc_acm_user_event_t;
+
+typedef struct app_usbd_class_inst_s app_usbd_class_inst_t;
+
+typedef void (*app_usbd_cdc_acm_user_ev_handler_t)(app_usbd_class_inst_t const* p_inst,
+                                                   app_usbd_cdc_acm_user_event_t event);
+
+typedef struct
+{
+    app_usbd_cdc_acm_user_ev_handler_t handler;
+} app_usbd_cdc_acm_t;
+
+#define APP_USBD_CDC_COMM_PROTOCOL_NONE 0
+
+#define CDC_ACM_COMM_INTERFACE 0
+#define CDC_ACM_DATA_INTERFACE 1
+#define CDC_ACM_COMM_EPIN      0
+#define CDC_ACM_DATA_EPIN      0
+#define CDC_ACM_DATA_EPOUT     0
+
+#define APP_USBD_CDC_ACM_GLOBAL_DEF(name, user_handler, ...) \
+    const app_usbd_cdc_acm_t name = {.handler = user_handler}
+
+app_usbd_class_inst_t const* app_usbd_cdc_acm_class_inst_get(app_usbd_cdc_acm_t const* p_cdc_acm);
+
+ret_code_t app_usbd_class_append(app_usbd_class_inst_t const* p_cinst);
+
+ret_code_t app_usbd_cdc_acm_read_any(app_usbd_cdc_acm_t const* p_cdc_acm, void* p_buf, size_t length);
+
+size_t app_usbd_cdc_acm_rx_size(app_usbd_cdc_acm_t const* p_cdc_acm);
+
+ret_code_t app_usbd_cdc_acm_write(app_usbd_cdc_acm_t const* p_cdc_acm, const void* p_buf, size_t length);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef APP_UTIL_PLATFORM_H
+#define APP_UTIL_PLATFORM_H
+
+#include <stdint.h>
+
+// the host harnesses are single-threaded, interrupt handlers are called directly
+#define CRITICAL_REGION_ENTER() do {
+#define CRITICAL_REGION_EXIT()  } while(0)
+
+// nrf52840 flash page, pulled in through nrf.h on the device
+#define CODE_PAGE_SIZE 4096
+
+#define STATIC_ASSERT(cond, msg) _Static_assert(cond, msg)
+
+#define STRINGIFY_(val) #val
+#define STRINGIFY(val)  STRINGIFY_(val)
+
+#endif
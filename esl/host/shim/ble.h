@@ -0,0 +1,17 @@
+#ifndef BLE_H
+#define BLE_H
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+// only the SoftDevice types named by the module headers, the host builds never touch the stack
+typedef struct
+{
+    uint16_t uuid;
+    uint8_t  type;
+} ble_uuid_t;
+
+typedef struct ble_evt_s ble_evt_t;
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stdint.h>
+
+// same CRC-16-CCITT as the SDK, seeded with 0xFFFF when p_crc is NULL
+uint16_t crc16_compute(uint8_t const* p_data, uint32_t size, uint16_t const* p_crc);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef NRF_DRV_USBD_H
+#define NRF_DRV_USBD_H
+
+#define NRF_DRV_USBD_EPSIZE 64
+
+#endif
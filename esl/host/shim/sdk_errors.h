@@ -0,0 +1,14 @@
+#ifndef SDK_ERRORS_H
+#define SDK_ERRORS_H
+
+#include <stdint.h>
+
+// host stand-in for the SDK error codes used by the modules built on Linux
+typedef uint32_t ret_code_t;
+
+#define NRF_SUCCESS            0
+#define NRF_ERROR_INVALID_STATE 8
+#define NRF_ERROR_BUSY         17
+#define NRF_ERROR_IO_PENDING   0x8000
+
+#endif
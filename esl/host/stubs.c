@@ -0,0 +1,199 @@
+#include <string.h>
+
+#include "leds.h"
+#include "strip.h"
+#include "anim.h"
+#include "flash.h"
+#include "macro.h"
+#include "bench.h"
+#include "service.h"
+#include "link.h"
+#include "stack.h"
+
+// device-only modules reached from the CLI and the frame protocol; the host harnesses drive
+// the command layer alone, so these only need to link and report an idle device
+
+ColorRGB ledsGetLED2State(void)
+{
+    return (ColorRGB){0};
+}
+
+void stripSetPixel(uint16_t idx, ColorRGB rgb)
+{
+}
+
+void stripCommit(void)
+{
+}
+
+static bool gStripSuspended = false;
+
+uint8_t* stripSuspend(void)
+{
+    static uint8_t scratch[STRIP_SCRATCH_BYTES];
+    gStripSuspended = true;
+    return scratch;
+}
+
+void stripResume(void)
+{
+    gStripSuspended = false;
+}
+
+bool hostStripIsSuspended(void)
+{
+    return gStripSuspended;
+}
+
+void animStop(void)
+{
+}
+
+bool animIsRunning(void)
+{
+    return false;
+}
+
+void animSetBudget(uint32_t budgetUs)
+{
+}
+
+AnimStats animGetStats(void)
+{
+    return (AnimStats){0};
+}
+
+AnimEffect animEffectFromName(const char* name)
+{
+    return AnimEffectNum;
+}
+
+void flashSaveColorRGBNamed(ColorRGB rgb, const char* name)
+{
+}
+
+FlashRetCode flashLoadColorRGBNamed(ColorRGB* rgb, const char* mark)
+{
+    return FlashRetCodeMetaNotFound;
+}
+
+FlashRetCode flashDeleteColorRGBNamed(const char* name)
+{
+    return FlashRetCodeMetaNotFound;
+}
+
+uint32_t flashRecordCountMeta(uint8_t pageIdx, Metadata metaRef)
+{
+    return 0;
+}
+
+FlashRetCode flashSaveMacro(const char* name, const uint8_t* steps, uint8_t len)
+{
+    return FlashRetCodeSuccess;
+}
+
+FlashRetCode flashDeleteMacro(const char* name)
+{
+    return FlashRetCodeMetaNotFound;
+}
+
+FlashRetCode flashRecordNext(uint8_t pageIdx, uint32_t* addr, uint16_t* len)
+{
+    return FlashRetCodeBeyondPage;
+}
+
+FlashRetCode flashImageBegin(uint8_t pageIdx, uint8_t* image)
+{
+    return FlashRetCodeSuccess;
+}
+
+FlashRetCode flashImageWrite(uint8_t pageIdx, uint16_t offset, const uint8_t* data, uint16_t len)
+{
+    return FlashRetCodeSuccess;
+}
+
+FlashRetCode flashImageCommit(uint8_t pageIdx, uint16_t len, uint16_t crc)
+{
+    return FlashRetCodeBadImage;
+}
+
+void flashImageAbort(void)
+{
+}
+
+FlashRetCode macroStart(const char* name, uint8_t repeats)
+{
+    return FlashRetCodeMetaNotFound;
+}
+
+void macroStop(void)
+{
+}
+
+uint8_t benchGetNum(void)
+{
+    return 0;
+}
+
+const char* benchGetName(uint8_t idx)
+{
+    return NULL;
+}
+
+uint8_t benchFind(const char* name)
+{
+    return 0;
+}
+
+void benchRun(uint8_t idx, uint8_t repeats, BenchResult* result)
+{
+    memset(result, 0, sizeof(*result));
+}
+
+BLENotifyStats bleServiceGetNotifyStats(void)
+{
+    return (BLENotifyStats){0};
+}
+
+bool bleServiceBulkSend(uint32_t bytes)
+{
+    return false;
+}
+
+BLEBulkStats bleServiceGetBulkStats(void)
+{
+    return (BLEBulkStats){0};
+}
+
+void bleLinkSetIdleTimeout(uint32_t timeoutMs)
+{
+}
+
+BLELinkStats bleLinkGetStats(void)
+{
+    return (BLELinkStats){0};
+}
+
+const char* bleLinkRegimeToName(BLELinkRegime regime)
+{
+    return "none";
+}
+
+void bleStackAdvConfigure(BLEAdvPhase phase, BLEAdvPhaseConfig config)
+{
+}
+
+BLEAdvStats bleStackAdvGetStats(void)
+{
+    return (BLEAdvStats){0};
+}
+
+const char* bleStackAdvPhaseToName(BLEAdvPhase phase)
+{
+    return "off";
+}
+
+BLEAdvPhase bleStackAdvPhaseFromName(const char* name)
+{
+    return BLEAdvPhaseNum;
+}
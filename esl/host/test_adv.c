@@ -0,0 +1,84 @@
+#include <stdio.h>
+
+#include "advphase.h"
+
+// the advertising phase transitions as the main loop applies posted EventAdvPhase, including
+// reports from the advertising module that a restart has overtaken in the queue
+
+#define TEST_CHECK(cond)                                                         \
+    do                                                                           \
+    {                                                                            \
+        ++gChecks;                                                               \
+        if(!(cond))                                                              \
+        {                                                                        \
+            printf("FAIL: %s:%d: %s\n", __FILE__, __LINE__, #cond);              \
+            ++gFailed;                                                           \
+        }                                                                        \
+    } while(0)
+
+static uint32_t gFailed = 0;
+static uint32_t gChecks = 0;
+
+// the schedule as it runs undisturbed: fast, slow, sleep, burst, sleep again
+static void testSchedule(void)
+{
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseOff, BLEAdvPhaseFast, AdvModuleIdle) == AdvPhaseActionStart);
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseFast, BLEAdvPhaseSlow, AdvModuleSlow) == AdvPhaseActionEnter);
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseSlow, BLEAdvPhaseSleep, AdvModuleIdle) == AdvPhaseActionEnter);
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseSleep, BLEAdvPhaseBurst, AdvModuleIdle) == AdvPhaseActionStart);
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseBurst, BLEAdvPhaseSleep, AdvModuleIdle) == AdvPhaseActionEnter);
+}
+
+// a switch press or a disconnect restarts fast while the module's report of the previous run
+// still waits in the queue
+static void testStaleReports(void)
+{
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseFast, BLEAdvPhaseSlow, AdvModuleFast) == AdvPhaseActionNone);
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseFast, BLEAdvPhaseSleep, AdvModuleFast) == AdvPhaseActionNone);
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseSlow, BLEAdvPhaseSleep, AdvModuleFast) == AdvPhaseActionNone);
+
+    // a burst runs fast only, a slow report can only be left over from before it
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseBurst, BLEAdvPhaseSlow, AdvModuleFast) == AdvPhaseActionNone);
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseBurst, BLEAdvPhaseSlow, AdvModuleSlow) == AdvPhaseActionNone);
+
+    // switched off by a connection: idle reports no longer put it to sleep
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseOff, BLEAdvPhaseSleep, AdvModuleIdle) == AdvPhaseActionNone);
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseOff, BLEAdvPhaseSlow, AdvModuleSlow) == AdvPhaseActionNone);
+}
+
+// the sleep tick may post a burst that a restart overtakes; only sleep starts one
+static void testBurst(void)
+{
+    for(BLEAdvPhase phase = BLEAdvPhaseFast; phase < BLEAdvPhaseNum; ++phase)
+        TEST_CHECK(advPhaseNext(phase, BLEAdvPhaseBurst, AdvModuleIdle) ==
+                   (phase == BLEAdvPhaseSleep ? AdvPhaseActionStart : AdvPhaseActionNone));
+}
+
+// restarts and switching off apply whatever the state
+static void testRequests(void)
+{
+    for(BLEAdvPhase phase = BLEAdvPhaseFast; phase < BLEAdvPhaseNum; ++phase)
+        for(AdvModuleMode mode = AdvModuleIdle; mode <= AdvModuleOther; ++mode)
+        {
+            TEST_CHECK(advPhaseNext(phase, BLEAdvPhaseFast, mode) == AdvPhaseActionStart);
+            TEST_CHECK(advPhaseNext(phase, BLEAdvPhaseOff, mode) == AdvPhaseActionEnter);
+        }
+
+    TEST_CHECK(advPhaseNext(BLEAdvPhaseFast, BLEAdvPhaseNum, AdvModuleIdle) == AdvPhaseActionNone);
+}
+
+int main(void)
+{
+    testSchedule();
+    testStaleReports();
+    testBurst();
+    testRequests();
+
+    if(gFailed != 0)
+    {
+        printf("FAIL: %u of %u checks\n", gFailed, gChecks);
+        return 1;
+    }
+    printf("%u checks passed\n", gChecks);
+    return 0;
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "aes.h"
+#include "bcast.h"
+
+// the broadcast command decoder and its dedup window against a software AES;
+// every advertisement is built the way a sender would, flags first, then the command
+
+#define TEST_GROUP 3
+
+#define TEST_CHECK(cond)                                                         \
+    do                                                                           \
+    {                                                                            \
+        ++gChecks;                                                               \
+        if(!(cond))                                                              \
+        {                                                                        \
+            printf("FAIL: %s:%d: %s\n", __FILE__, __LINE__, #cond);              \
+            ++gFailed;                                                           \
+        }                                                                        \
+    } while(0)
+
+static const uint8_t gKey[BCAST_KEY_LEN] =
+{
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+
+static const uint8_t gKeyOther[BCAST_KEY_LEN] =
+{
+    0xf0, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+
+static uint32_t gFailed = 0;
+static uint32_t gChecks = 0;
+
+static uint8_t testAdv(const uint8_t* key, uint8_t group, uint32_t seq, uint8_t* adv)
+{
+    BcastCommand cmd =
+    {
+        .group  = group,
+        .seq    = seq,
+        .hsv    = {.h = seq & 0xFF, .s = 200, .v = 100},
+        .fadeMs = 500
+    };
+
+    adv[0] = 2;
+    adv[1] = 0x01;
+    adv[2] = 0x06;
+    adv[3] = 1 + 2 + BCAST_CMD_LEN;
+    adv[4] = 0xFF;
+    adv[5] = BCAST_COMPANY_ID & 0xFF;
+    adv[6] = BCAST_COMPANY_ID >> 8;
+    return 7 + bcastEncode(key, aesEncryptBlock, &cmd, &adv[7]);
+}
+
+static BcastResult testSend(BcastReceiver* rx, uint8_t group, uint32_t seq)
+{
+    uint8_t      adv[31];
+    uint8_t      len = testAdv(gKey, group, seq, adv);
+    BcastCommand cmd;
+
+    return bcastDecode(rx, adv, len, &cmd);
+}
+
+// FIPS-197 appendix C.1, the MAC is only as good as the block cipher under it
+static void testCipher(void)
+{
+    static const uint8_t plain[BCAST_BLOCK_LEN] =
+    {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+    static const uint8_t expected[BCAST_BLOCK_LEN] =
+    {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+    uint8_t out[BCAST_BLOCK_LEN];
+
+    aesEncryptBlock(gKey, plain, out);
+    TEST_CHECK(memcmp(out, expected, sizeof(out)) == 0);
+}
+
+static void testDecode(void)
+{
+    BcastReceiver rx;
+    BcastCommand  cmd;
+    uint8_t       adv[31];
+    uint8_t       len;
+
+    bcastReceiverInit(&rx, gKey, aesEncryptBlock, TEST_GROUP);
+
+    len = testAdv(gKey, TEST_GROUP, 0x12345678, adv);
+    TEST_CHECK(bcastDecode(&rx, adv, len, &cmd) == BcastResultAccepted);
+    TEST_CHECK(cmd.group == TEST_GROUP && cmd.seq == 0x12345678 && cmd.fadeMs == 500);
+    TEST_CHECK(cmd.hsv.h == 0x78 && cmd.hsv.s == 200 && cmd.hsv.v == 100);
+
+    // every single bit flip of the command, MAC included, is rejected
+    for(uint8_t pos = 8; pos < len; ++pos)
+        for(uint8_t bit = 0; bit < 8; ++bit)
+        {
+            len = testAdv(gKey, TEST_GROUP, 0x12341300, adv);
+            adv[pos] ^= 1 << bit;
+            TEST_CHECK(bcastDecode(&rx, adv, len, &cmd) == BcastResultBadMAC);
+        }
+
+    len = testAdv(gKeyOther, TEST_GROUP, 0x12341301, adv);
+    TEST_CHECK(bcastDecode(&rx, adv, len, &cmd) == BcastResultBadMAC);
+
+    // not commands: wrong company id, version, field length, truncated or malformed structures
+    len = testAdv(gKey, TEST_GROUP, 0x12341302, adv);
+    adv[5] ^= 1;
+    TEST_CHECK(bcastDecode(&rx, adv, len, &cmd) == BcastResultNotCommand);
+
+    len = testAdv(gKey, TEST_GROUP, 0x12341303, adv);
+    adv[7] = BCAST_VERSION + 1;
+    TEST_CHECK(bcastDecode(&rx, adv, len, &cmd) == BcastResultNotCommand);
+
+    len = testAdv(gKey, TEST_GROUP, 0x12341304, adv);
+    TEST_CHECK(bcastDecode(&rx, adv, len - 1, &cmd) == BcastResultNotCommand);
+
+    adv[3] = 0;
+    TEST_CHECK(bcastDecode(&rx, adv, len, &cmd) == BcastResultNotCommand);
+
+    adv[0] = 30;
+    TEST_CHECK(bcastDecode(&rx, adv, len, &cmd) == BcastResultNotCommand);
+    TEST_CHECK(bcastDecode(&rx, adv, 0, &cmd) == BcastResultNotCommand);
+
+    // none of the rejected commands above moved the window
+    TEST_CHECK(rx.seqTop == 0x12345678);
+}
+
+static void testGroups(void)
+{
+    BcastReceiver rx;
+
+    bcastReceiverInit(&rx, gKey, aesEncryptBlock, TEST_GROUP);
+    TEST_CHECK(testSend(&rx, TEST_GROUP + 1, 10) == BcastResultOtherGroup);
+    TEST_CHECK(!rx.seqValid);
+    TEST_CHECK(testSend(&rx, BCAST_GROUP_ALL, 10) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 11) == BcastResultAccepted);
+}
+
+static void testWindow(void)
+{
+    BcastReceiver rx;
+
+    bcastReceiverInit(&rx, gKey, aesEncryptBlock, TEST_GROUP);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 100) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 100) == BcastResultDuplicate);
+
+    // reordered within the window: accepted once each
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 105) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 103) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 103) == BcastResultDuplicate);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 101) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 105) == BcastResultDuplicate);
+
+    // the oldest number still in the window, then the first one past it
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 105 - (BCAST_WINDOW_LEN - 1)) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 105 - BCAST_WINDOW_LEN) == BcastResultDuplicate);
+
+    // a jump past the window forgets everything behind it
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 105 + 2 * BCAST_WINDOW_LEN) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 105 + BCAST_WINDOW_LEN + 1) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 105) == BcastResultDuplicate);
+
+    // captured commands from far behind, half the old 16-bit range and more, stay replays
+    bcastReceiverInit(&rx, gKey, aesEncryptBlock, TEST_GROUP);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 40000) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 40000 - 0x8000) == BcastResultDuplicate);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 40000 - 0x8001) == BcastResultDuplicate);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 1) == BcastResultDuplicate);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 0) == BcastResultDuplicate);
+    TEST_CHECK(rx.seqTop == 40000);
+
+    // the sequence does not wrap, past its end nothing is newer
+    bcastReceiverInit(&rx, gKey, aesEncryptBlock, TEST_GROUP);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 0xFFFFFFFE) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 0xFFFFFFFF) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 0x00000000) == BcastResultDuplicate);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 0x7FFFFFFF) == BcastResultDuplicate);
+    TEST_CHECK(rx.seqTop == 0xFFFFFFFF);
+}
+
+// what the observer does at boot with the persisted high-water mark: nothing up to it is
+// accepted again, whether it was accepted, skipped or never sent before the reboot
+static void testRestore(void)
+{
+    BcastReceiver rx;
+
+    bcastReceiverInit(&rx, gKey, aesEncryptBlock, TEST_GROUP);
+    bcastReceiverRestore(&rx, 264);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 200) == BcastResultDuplicate);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 263) == BcastResultDuplicate);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 264) == BcastResultDuplicate);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 265) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 264) == BcastResultDuplicate);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 267) == BcastResultAccepted);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 266) == BcastResultAccepted);
+
+    // a receiver that was never restored takes the first authentic command, replay or not
+    bcastReceiverInit(&rx, gKey, aesEncryptBlock, TEST_GROUP);
+    TEST_CHECK(testSend(&rx, TEST_GROUP, 200) == BcastResultAccepted);
+}
+
+int main(void)
+{
+    testCipher();
+    testDecode();
+    testGroups();
+    testWindow();
+    testRestore();
+
+    if(gFailed != 0)
+    {
+        printf("FAIL: %u of %u checks\n", gFailed, gChecks);
+        return 1;
+    }
+    printf("%u checks passed\n", gChecks);
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "wave.h"
+
+// the CORDIC waveform against libm over the full phase range: sine and cosine within 1 LSB
+// of Q15, the breathing level within 1 LSB of its 8-bit scale
+
+#define TEST_PHASE_STEP 4099
+#define TEST_TOLERANCE  1
+
+#define TEST_CHECK(cond)                                                         \
+    do                                                                           \
+    {                                                                            \
+        ++gChecks;                                                               \
+        if(!(cond))                                                              \
+        {                                                                        \
+            if(gFailed < 10)                                                     \
+                printf("FAIL: %s:%d: %s at phase 0x%08x\n", __FILE__, __LINE__, #cond, phase); \
+            ++gFailed;                                                           \
+        }                                                                        \
+    } while(0)
+
+static uint32_t gFailed = 0;
+static uint32_t gChecks = 0;
+static int32_t  gErrMax[3];
+
+static int32_t testQ15(float value)
+{
+    int32_t q = lrintf(value * 32768.0f);
+    return q > INT16_MAX ? INT16_MAX : q;
+}
+
+static int32_t testErr(int32_t got, int32_t expected, uint8_t idx)
+{
+    int32_t err = abs(got - expected);
+    if(err > gErrMax[idx])
+        gErrMax[idx] = err;
+    return err;
+}
+
+static void testPhase(uint32_t phase)
+{
+    float   angle = (float)(phase * (2.0 * M_PI / 4294967296.0));
+    int16_t sinQ15, cosQ15;
+
+    waveSinCosQ15(phase, &sinQ15, &cosQ15);
+    TEST_CHECK(testErr(sinQ15, testQ15(sinf(angle)), 0) <= TEST_TOLERANCE);
+    TEST_CHECK(testErr(cosQ15, testQ15(cosf(angle)), 1) <= TEST_TOLERANCE);
+    TEST_CHECK(waveSinQ15(phase) == sinQ15 && waveCosQ15(phase) == cosQ15);
+
+    int32_t level = lrintf(UINT8_MAX * (1.0f - cosf(angle)) / 2.0f);
+    TEST_CHECK(testErr(waveRaisedCos(phase), level, 2) <= TEST_TOLERANCE);
+}
+
+int main(void)
+{
+    // every quadrant boundary and its neighbours, then a sweep that hits all of them off grid
+    for(uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+        for(int32_t delta = -2; delta <= 2; ++delta)
+            testPhase(quadrant * 0x40000000UL + delta);
+
+    uint32_t phase = 0;
+    do
+    {
+        testPhase(phase);
+        phase += TEST_PHASE_STEP;
+    } while(phase >= TEST_PHASE_STEP);
+
+    printf("max error: sin %d, cos %d, raised cos %d LSB\n", gErrMax[0], gErrMax[1], gErrMax[2]);
+    if(gFailed != 0)
+    {
+        printf("FAIL: %u of %u checks\n", gFailed, gChecks);
+        return 1;
+    }
+    printf("%u checks passed\n", gChecks);
+    return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BENCH_REPEATS_MAX 64
+#define BENCH_WARMUP      4
+
+typedef struct
+{
+    uint32_t min;
+    uint32_t median;
+    uint32_t max;
+} BenchResult;
+
+uint8_t benchGetNum(void);
+
+const char* benchGetName(uint8_t idx);
+
+uint8_t benchFind(const char* name);
+
+void benchRun(uint8_t idx, uint8_t repeats, BenchResult* result);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef ADVPHASE_H
+#define ADVPHASE_H
+
+#include "stack.h"
+
+// where the advertising module itself is, as far as the phase scheduler cares
+typedef enum
+{
+    AdvModuleIdle,
+    AdvModuleFast,
+    AdvModuleSlow,
+    AdvModuleOther
+} AdvModuleMode;
+
+typedef enum
+{
+    AdvPhaseActionNone,
+    AdvPhaseActionStart,
+    AdvPhaseActionEnter
+} AdvPhaseAction;
+
+// what a posted phase change does given the current phase and the module's mode when it is applied:
+// start advertising in the requested phase, only record it, or drop it as overtaken
+AdvPhaseAction advPhaseNext(BLEAdvPhase current, BLEAdvPhase requested, AdvModuleMode mode);
+
+#endif
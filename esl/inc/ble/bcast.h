@@ -0,0 +1,71 @@
+#ifndef BCAST_H
+#define BCAST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "utils.h"
+
+// command advertisements share the testing company identifier with the state advertising,
+// the first payload byte tells them apart
+#define BCAST_COMPANY_ID 0xFFFF
+#define BCAST_VERSION    0x82
+
+// version, group, seq (4), h, s, v, fade ms (2), mac (4)
+#define BCAST_BODY_LEN 11
+#define BCAST_MAC_LEN  4
+#define BCAST_CMD_LEN  (BCAST_BODY_LEN + BCAST_MAC_LEN)
+
+#define BCAST_KEY_LEN   16
+#define BCAST_BLOCK_LEN 16
+
+// group 0 addresses every receiver
+#define BCAST_GROUP_ALL 0
+
+// sequence numbers this far behind the newest one are still checked for duplicates;
+// the sequence never wraps, a sender that reaches UINT32_MAX needs a new key
+#define BCAST_WINDOW_LEN 32
+
+typedef enum
+{
+    BcastResultAccepted,
+    BcastResultNotCommand,
+    BcastResultBadMAC,
+    BcastResultOtherGroup,
+    BcastResultDuplicate,
+    BcastResultNum
+} BcastResult;
+
+typedef struct
+{
+    uint8_t  group;
+    uint32_t seq;
+    ColorHSV hsv;
+    uint16_t fadeMs;
+} BcastCommand;
+
+// one AES-128 block, ECB; the firmware backs it with the SoftDevice, a host build with any AES
+typedef void (*BcastCipher)(const uint8_t key[BCAST_KEY_LEN], const uint8_t in[BCAST_BLOCK_LEN],
+                            uint8_t out[BCAST_BLOCK_LEN]);
+
+typedef struct
+{
+    const uint8_t* key;
+    BcastCipher    cipher;
+    uint8_t        group;
+    bool           seqValid;
+    uint32_t       seqTop;
+    uint32_t       seqSeen;
+} BcastReceiver;
+
+void bcastReceiverInit(BcastReceiver* rx, const uint8_t* key, BcastCipher cipher, uint8_t group);
+
+// resumes past a persisted mark at or beyond every number accepted before the reboot,
+// nothing up to it is accepted again
+void bcastReceiverRestore(BcastReceiver* rx, uint32_t seqMark);
+
+BcastResult bcastDecode(BcastReceiver* rx, const uint8_t* adv, uint16_t len, BcastCommand* cmd);
+
+uint8_t bcastEncode(const uint8_t* key, BcastCipher cipher, const BcastCommand* cmd, uint8_t* dst);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdint.h>
+
+#include "ble.h"
+
+typedef enum
+{
+    BLELinkRegimeNone,
+    BLELinkRegimeActive,
+    BLELinkRegimeIdle,
+    BLELinkRegimeNum
+} BLELinkRegime;
+
+typedef struct
+{
+    uint8_t  regime;
+    uint16_t interval;      // 1.25 ms units
+    uint16_t latency;
+    uint32_t idleTimeoutMs;
+    uint32_t transitions;
+    uint32_t regimeMs[BLELinkRegimeNum];
+} BLELinkStats;
+
+void bleLinkSetup(void);
+
+void bleLinkOnEvent(ble_evt_t const* evt);
+
+void bleLinkSetIdleTimeout(uint32_t timeoutMs);
+
+BLELinkStats bleLinkGetStats(void);
+
+const char* bleLinkRegimeToName(BLELinkRegime regime);
+
+#endif
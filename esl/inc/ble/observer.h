@@ -0,0 +1,34 @@
+#ifndef OBSERVER_H
+#define OBSERVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ble.h"
+
+#include "bcast.h"
+
+// set by the s140 build variant, S113 has no scanner
+#ifndef BLE_OBSERVER_ENABLED
+#define BLE_OBSERVER_ENABLED 0
+#endif
+
+typedef struct
+{
+    uint32_t reports;
+    uint32_t results[BcastResultNum];
+    uint8_t  group;
+} BLEObserverStats;
+
+void bleObserverSetup(void);
+
+void bleObserverOnEvent(ble_evt_t const* evt);
+
+void bleObserverSetGroup(uint8_t group);
+
+// writes the dedup window to flash once accepted commands have moved it
+void bleObserverPersist(void);
+
+BLEObserverStats bleObserverGetStats(void);
+
+#endif
@@ -2,6 +2,7 @@
 #define SERVICE_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "ble.h"
 
@@ -14,23 +15,41 @@ typedef struct
 {
     ble_uuid_t uuid;
     uint16_t   hserv;
-    uint16_t   hconn;
 } BLEService;
 
 typedef struct
 {
-    ble_uuid_t               uuid;
-    ble_gatts_attr_md_t      attrmd;
-    ble_gatts_char_md_t      charmd;
-    ble_gatts_char_handles_t handles;
-} BLEAttr;
+    uint32_t sent;
+    uint32_t coalesced;
+    uint32_t failed;
+    uint32_t avoided;
+} BLENotifyStats;
 
-ret_code_t bleServiceSetup(void);
+typedef struct
+{
+    uint32_t rxBytes;
+    uint32_t rxChunks;
+    uint32_t rxSeqErrors;
+    uint32_t rxKBps;
+    uint32_t txBytes;
+    uint32_t txKBps;
+    uint16_t mtu;
+    uint8_t  dataLength;
+    uint8_t  phy;
+} BLEBulkStats;
+
+// registers the service and every characteristic of the table in service.c
+ret_code_t bleServiceSetup(const ColorHSV* hsv);
+
+void bleServiceOnEvent(ble_evt_t const* evt);
+
+BLENotifyStats bleServiceGetNotifyStats(void);
 
-ret_code_t bleServiceAttrHSVSetup(ColorHSV* ptr);
 ret_code_t bleServiceAttrHSVNotify(void);
-uint32_t   bleServiceAttrHSVGetHandle(void);
+bool       bleServiceAttrHSVIsSubscribed(void);
 
-ret_code_t bleServiceAttrInputSetup(ColorHSV* ptr);
+bool         bleServiceBulkSend(uint32_t bytes);
+void         bleServiceOnGATTUpdate(uint16_t hconn, uint16_t mtu, uint8_t dataLength);
+BLEBulkStats bleServiceGetBulkStats(void);
 
 #endif
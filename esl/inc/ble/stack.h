@@ -1,6 +1,54 @@
 #ifndef STACK_H
 #define STACK_H
 
+#include <stdint.h>
+
+#include "utils.h"
+
+typedef enum
+{
+    BLEAdvPhaseFast,
+    BLEAdvPhaseSlow,
+    BLEAdvPhaseBurst,
+    BLEAdvPhaseSleep,
+    BLEAdvPhaseOff,
+    BLEAdvPhaseNum
+} BLEAdvPhase;
+
+typedef struct
+{
+    uint16_t intervalMs;
+    uint16_t durationS;
+} BLEAdvPhaseConfig;
+
+typedef struct
+{
+    uint32_t ms;
+    uint32_t events;
+    uint32_t radioMs;
+} BLEAdvPhaseStats;
+
+typedef struct
+{
+    uint8_t          phase;
+    BLEAdvPhaseStats phases[BLEAdvPhaseNum];
+} BLEAdvStats;
+
 void bleStackSetup(void);
 
+void bleStackAdvUpdate(ColorHSV color, uint8_t mode);
+
+void bleStackAdvRestart(void);
+
+// applies a phase change posted as EventAdvPhase
+void bleStackAdvProcess(BLEAdvPhase phase);
+
+void bleStackAdvConfigure(BLEAdvPhase phase, BLEAdvPhaseConfig config);
+
+BLEAdvStats bleStackAdvGetStats(void);
+
+const char* bleStackAdvPhaseToName(BLEAdvPhase phase);
+
+BLEAdvPhase bleStackAdvPhaseFromName(const char* name);
+
 #endif
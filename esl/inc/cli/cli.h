@@ -1,6 +1,21 @@
 #ifndef CLI_H
 #define CLI_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum
+{
+    CliModeText,
+    CliModeBinary
+} CliMode;
+
 void cliSetup(void);
 
+void cliSetMode(CliMode mode);
+
+bool cliWrite(const char* data, size_t len);
+
+void cliExecLines(void);
+
 #endif
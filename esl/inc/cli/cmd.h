@@ -1,9 +1,43 @@
 #ifndef CMD_H
 #define CMD_H
 
+// name, handler suffix (cliCmd<Handler> in cli.c), min and max argument count;
+// entries must stay sorted by name, commands are looked up with a binary search
+#define CMD_TABLE(X)                             \
+    X("anim",          Anim,        1, 2)        \
+    X("anim_budget",   AnimBudget,  1, 1)        \
+    X("anim_stats",    AnimStats,   0, 0)        \
+    X("bcast",         Bcast,       0, 1)        \
+    X("bench",         Bench,       0, 2)        \
+    X("binary",        Binary,      0, 0)        \
+    X("ble_adv",       BleAdv,      0, 3)        \
+    X("ble_bulk",      BleBulk,     0, 1)        \
+    X("ble_link",      BleLink,     0, 1)        \
+    X("ble_stats",     BleStats,    0, 0)        \
+    X("cli_stats",     CliStats,    0, 0)        \
+    X("color_add_cur", ColorAddCur, 1, 1)        \
+    X("color_add_rgb", ColorAddRgb, 4, 4)        \
+    X("color_del",     ColorDel,    1, 1)        \
+    X("color_set",     ColorSet,    1, 1)        \
+    X("flash_dump",    FlashDump,   0, 1)        \
+    X("flash_load",    FlashLoad,   2, 4)        \
+    X("help",          Help,        0, 0)        \
+    X("hsv",           Hsv,         3, 3)        \
+    X("macro",         Macro,       1, 2)        \
+    X("macro_add",     MacroAdd,    2, PARSE_TOKEN_NUM_MAX - 1) \
+    X("macro_del",     MacroDel,    1, 1)        \
+    X("macro_stop",    MacroStop,   0, 0)        \
+    X("power",         Power,       0, 0)        \
+    X("power_budget",  PowerBudget, 1, 1)        \
+    X("rgb",           Rgb,         3, 3)
+
 static const char gCmdResponseUnknownCmd[] = "Unknown command (enter 'help' for help)\r\n";
 
-static const char gCmdHelp[]               = "help";
+static const char gCmdResponseBadArgs[]    = "Wrong number of arguments (enter 'help' for help)\r\n";
+
+static const char gCmdResponseBadValue[]   = "Malformed or out of range number\r\n";
+
+static const char gCmdResponseLineLong[]   = "Line too long, discarded\r\n";
 
 static const char gCmdResponseHelp[]       = "Available commands:\r\n"
                                              "help                             -- prints this message\r\n"
@@ -12,22 +46,59 @@ static const char gCmdResponseHelp[]       = "Available commands:\r\n"
                                              "color_add_rgb <r> <g> <b> <name> -- memorizes LED2 state according to RGB input (0 <= <i> <= 255)\r\n"
                                              "color_add_cur <name>             -- memorizes current LED2 state\r\n"
                                              "color_set <name>                 -- sets LED2 state according to prev. memorized state named <name>,\r\n"
-                                             "color_del <name>                 -- deletes LED2 state named <name>\r\n";
+                                             "color_del <name>                 -- deletes LED2 state named <name>\r\n"
+                                             "anim <effect> <period>           -- runs <effect> (rainbow, pulse, fade, strobe, off) with <period> in ms\r\n"
+                                             "anim_budget <us>                 -- sets per-frame CPU budget of effects in us\r\n"
+                                             "anim_stats                       -- prints animation frame statistics\r\n"
+                                             "power                            -- prints estimated LED current and limiter state\r\n"
+                                             "power_budget <ma>                -- sets LED current budget in mA\r\n"
+                                             "cli_stats                        -- prints USB handler timing and line counters\r\n"
+                                             "binary                           -- switches to the framed binary protocol (opcode 0x7F returns)\r\n"
+                                             "macro_add <name> <steps>         -- stores a macro, steps are 'rgb <r> <g> <b>', 'hsv <h> <s> <v>', 'delay <ms>'\r\n"
+                                             "macro <name> [repeats]           -- plays a stored macro, 0 repeats loops until macro_stop\r\n"
+                                             "macro_stop                       -- stops the playing macro\r\n"
+                                             "macro_del <name>                 -- deletes a stored macro\r\n"
+                                             "flash_dump [page]                -- prints live records of pages 1-2 (or <page>) as flash_load lines\r\n"
+                                             "flash_load <page> begin|<offset> <hex>|commit <len> <crc>|abort\r\n"
+                                             "                                 -- stages a page image, pausing the strip, and writes it once\r\n"
+                                             "                                 -- the CRC16 and every record check out; abort, any rejected\r\n"
+                                             "                                 -- line or closing the port discards it and resumes the strip\r\n"
+                                             "ble_stats                        -- prints BLE notification counters\r\n"
+                                             "ble_link [idle_s]                -- prints connection regime and time spent in each, sets the idle timeout\r\n"
+                                             "ble_adv [phase ms s]             -- prints advertising phase and estimated radio time per phase,\r\n"
+                                             "                                 -- sets interval and duration of fast|slow|burst|sleep\r\n"
+                                             "ble_bulk [kb]                    -- streams <kb> KiB over the bulk characteristic, prints link and throughput\r\n"
+                                             "bcast [group]                    -- prints group broadcast counters, sets the group (s140 build)\r\n"
+                                             "bench [name|all] [repeats]       -- runs micro-benchmarks, prints min/median/max DWT cycles\r\n"
+                                             "Several commands may be given on one line separated by ';'\r\n";
 
-static const char gCmdRgb[]                = "rgb";
+static const char gCmdResponseNoSpace[]    = "There is no space left to save that record! Delete something first\r\n";
 
-static const char gCmdHsv[]                = "hsv";
+static const char gCmdResponseNoColor[]    = "There is no color named like that!\r\n";
 
-static const char gCmdColorAddRgb[]        = "color_add_rgb";
+static const char gCmdResponseNoEffect[]   = "There is no effect named like that!\r\n";
 
-static const char gCmdResponseNoSpace[]    = "There is no space left to save that record! Delete something first\r\n";
+static const char gCmdResponseBinary[]     = "Binary mode\r\n";
 
-static const char gCmdColorAddCur[]        = "color_add_cur";
+// format, takes the name length and the step token limit
+static const char gCmdResponseBadMacro[]   = "Malformed macro (name up to %u chars, steps up to %u tokens: rgb and hsv take 4, delay 2)\r\n";
 
-static const char gCmdColorSet[]           = "color_set";
+static const char gCmdResponseNoMacro[]    = "There is no macro named like that!\r\n";
 
-static const char gCmdResponseNoColor[]    = "There is no color named like that!\r\n";
+static const char gCmdResponseImageRejected[] = "Page image rejected (page, offset, hex or CRC), upload discarded\r\n";
+
+static const char gCmdResponseImageAborted[]  = "Page image discarded\r\n";
+
+static const char gCmdResponsePageWritten[]   = "Page written\r\n";
+
+static const char gCmdResponsePageBad[]       = "Page read back differs from the image, load it again\r\n";
+
+static const char gCmdResponseNoBench[]    = "There is no benchmark named like that!\r\n";
+
+static const char gCmdResponseNoObserver[] = "Group broadcasts need the s140 build\r\n";
+
+static const char gCmdResponseNoBulk[]     = "Bulk stream needs a connection with notifications enabled\r\n";
 
-static const char gCmdColorDel[]           = "color_del";
+static const char gCmdResponseNoPhase[]    = "There is no advertising phase named like that!\r\n";
 
 #endif
@@ -0,0 +1,17 @@
+#ifndef COBS_H
+#define COBS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// consistent overhead byte stuffing: encoded data holds no 0x00, which is left to delimit frames;
+// one code byte per 254 data bytes plus the leading code and the delimiter
+#define COBS_ENCODED_MAX(len) ((len) + (len) / 254 + 2)
+
+// writes the encoding of src followed by the 0x00 delimiter, returns the bytes written
+size_t cobsEncode(uint8_t* dst, const uint8_t* src, size_t len);
+
+// decodes in place, data excludes the delimiter; returns the decoded length or 0 if malformed
+size_t cobsDecode(uint8_t* data, size_t len);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cobs.h"
+
+// decoded frame: <seq> <opcode> <payload...> <crc16 LE>, COBS encoded and terminated by 0x00;
+// every request is answered with <seq> <opcode | FRAME_OP_RESPONSE> <status> <payload...> <crc16 LE>
+typedef enum
+{
+    FrameOpSetRGB    = 0x01,
+    FrameOpSetHSV    = 0x02,
+    FrameOpSetPixels = 0x03,
+    FrameOpState     = 0x10,
+    FrameOpTelemetry = 0x11,
+    FrameOpText      = 0x7F
+} FrameOp;
+
+#define FRAME_OP_RESPONSE 0x80
+
+#define FRAME_HEADER_SIZE 2
+#define FRAME_CRC_SIZE    2
+#define FRAME_PAYLOAD_MAX 248
+#define FRAME_DECODED_MAX (FRAME_HEADER_SIZE + FRAME_PAYLOAD_MAX + FRAME_CRC_SIZE)
+#define FRAME_ENCODED_MAX COBS_ENCODED_MAX(FRAME_DECODED_MAX)
+
+// pixel payloads wait in these slots until the main loop applies them, see frameApplyPixels()
+#define FRAME_PIXEL_SLOTS 2
+#define FRAME_PIXEL_MAX   ((FRAME_PAYLOAD_MAX - 2) / 3)
+
+// RX, response and TX buffers plus the pixel slots (start, count and padding ahead of the colors)
+#define FRAME_RAM_BYTES (2 * FRAME_ENCODED_MAX + FRAME_DECODED_MAX + FRAME_PIXEL_SLOTS * (4 + 3 * FRAME_PIXEL_MAX))
+
+typedef enum
+{
+    FrameStatusSuccess,
+    FrameStatusBadCRC,
+    FrameStatusBadLength,
+    FrameStatusBadOp,
+    FrameStatusBusy
+} FrameStatus;
+
+void frameReset(void);
+
+// returns the bytes consumed, fewer than size if a frame switched the CLI back to text mode
+size_t frameReceive(const uint8_t* data, size_t size);
+
+void frameApplyPixels(void);
+
+#endif
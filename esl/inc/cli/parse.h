@@ -0,0 +1,33 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// macro definitions are the longest commands, one token per step field
+#define PARSE_TOKEN_NUM_MAX 48
+
+// tokens are spans into the line, each one NUL-terminated in place;
+// lines must be shorter than 256 characters
+typedef struct
+{
+    uint8_t offset;
+    uint8_t length;
+} ParseToken;
+
+typedef struct
+{
+    char*      line;
+    ParseToken tokens[PARSE_TOKEN_NUM_MAX];
+    uint8_t    num;
+} ParseArgs;
+
+bool parseTokenize(ParseArgs* args, char* line);
+
+char* parseArg(const ParseArgs* args, uint8_t idx);
+
+bool parseNumber(const char* str, uint32_t max, uint32_t* value);
+
+bool parseHex(uint8_t* dst, const char* hex, uint16_t len);
+
+#endif
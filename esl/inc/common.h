@@ -1,10 +1,6 @@
 #ifndef COMMON_H
 #define COMMON_H
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
 typedef enum
 {
     LogicalStateOff,
@@ -0,0 +1,60 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "utils.h"
+
+typedef enum
+{
+    AnimEffectNone,
+    AnimEffectRainbow,
+    AnimEffectPulse,
+    AnimEffectFade,
+    AnimEffectStrobe,
+    AnimEffectStream,
+    AnimEffectNum
+} AnimEffect;
+
+typedef struct
+{
+    uint8_t  effect;
+    uint16_t periodMs;
+} AnimParams;
+
+typedef struct
+{
+    uint32_t frames;
+    uint32_t overruns;
+    uint32_t lastUs;
+    uint32_t maxUs;
+    uint32_t budgetUs;
+    uint32_t streamColors;
+    uint32_t streamDropped;
+    uint32_t streamResyncs;
+} AnimStats;
+
+void animSetup(void);
+
+void animStart(AnimParams params, ColorHSV color);
+
+void animStop(void);
+
+bool animIsRunning(void);
+
+void animSetColor(ColorHSV color);
+
+void animSetBudget(uint32_t budgetUs);
+
+void animProcessFrame(void);
+
+AnimStats animGetStats(void);
+
+uint8_t animStreamPush(uint16_t tsMs, uint8_t intervalMs, const ColorRGB* colors, uint8_t num);
+
+AnimEffect animEffectFromName(const char* name);
+
+const char* animEffectToName(AnimEffect effect);
+
+#endif
@@ -28,10 +28,16 @@ void ledsSetLED2StateRGB(ColorRGB rgb);
 
 void ledsSetLED2StateHSV(ColorHSV hsv);
 
+void ledsBatchBegin(void);
+
+void ledsBatchEnd(void);
+
 void ledsSetupLED1Timer(void);
 
 void ledsFlashLED1(FlashMode mode);
 
+void ledsFlashLED1Period(uint16_t periodMs);
+
 void ledsFlashLED1Halt(void);
 
 #endif
@@ -0,0 +1,50 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+// brightness scale applied by the limiter, Q8
+#define POWER_SCALE_UNITY 256
+
+typedef enum
+{
+    PowerSourceOnboard,
+    PowerSourceStrip,
+    PowerSourceNum
+} PowerSource;
+
+// layout is exposed as is over BLE
+typedef struct
+{
+    uint16_t estimateMA;
+    uint16_t drawnMA;
+    uint16_t budgetMA;
+    uint16_t scale;
+} PowerTelemetry;
+
+// estimate and drawn include the fixed draw, which is board plus idle LED current
+typedef struct
+{
+    uint32_t estimateUA;
+    uint32_t fixedUA;
+    uint32_t drawnUA;
+    uint32_t budgetMA;
+    uint16_t scale;
+    uint32_t commits;
+    uint32_t commitsLimited;
+} PowerStats;
+
+uint16_t powerUpdate(PowerSource source, uint32_t idleUA, uint32_t dynamicUA);
+
+void powerSetBudget(uint32_t budgetMA);
+
+PowerStats powerGetStats(void);
+
+PowerTelemetry* powerGetTelemetry(void);
+
+static inline uint8_t powerScale(uint8_t value, uint16_t scale)
+{
+    return (value * scale) >> 8;
+}
+
+#endif
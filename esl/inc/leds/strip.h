@@ -0,0 +1,43 @@
+#ifndef STRIP_H
+#define STRIP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "utils.h"
+
+#ifndef STRIP_PIXEL_NUM
+#define STRIP_PIXEL_NUM 300
+#endif
+
+// boards without a strip build with STRIP_FITTED=0, its current is then left out of the budget
+#ifndef STRIP_FITTED
+#define STRIP_FITTED 1
+#endif
+
+// bytes lent out by stripSuspend(), at least one flash page
+#define STRIP_SCRATCH_BYTES 4096
+
+void stripSetup(void);
+
+uint16_t stripGetPixelNum(void);
+
+void stripSetPixel(uint16_t idx, ColorRGB rgb);
+
+ColorRGB stripGetPixel(uint16_t idx);
+
+void stripSetFrame(const ColorRGB* frame, uint16_t len);
+
+void stripFill(ColorRGB rgb);
+
+void stripCommit(void);
+
+bool stripIsBusy(void);
+
+// lends the frame and PWM memory out as STRIP_SCRATCH_BYTES of scratch, e.g. to stage a flash page;
+// setters and commits are ignored until stripResume()
+uint8_t* stripSuspend(void);
+
+void stripResume(void);
+
+#endif
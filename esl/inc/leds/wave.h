@@ -0,0 +1,27 @@
+#ifndef WAVE_H
+#define WAVE_H
+
+#include <stdint.h>
+
+// phase is expressed in turns scaled to 2^32, so it wraps naturally
+typedef struct
+{
+    uint32_t phase;
+    uint32_t step;
+} Wave;
+
+void waveSetup(Wave* wave, uint32_t periodMs, uint32_t tickMs);
+
+uint32_t waveAdvance(Wave* wave);
+
+uint32_t wavePhase(uint32_t t, uint32_t period);
+
+void waveSinCosQ15(uint32_t phase, int16_t* sinQ15, int16_t* cosQ15);
+
+int16_t waveSinQ15(uint32_t phase);
+
+int16_t waveCosQ15(uint32_t phase);
+
+uint8_t waveRaisedCos(uint32_t phase);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef WS2812_H
+#define WS2812_H
+
+#include <stdint.h>
+
+#include "utils.h"
+
+// one PWM duty value per bit at 16MHz / 20 = 800kHz, 1.25us per slot
+#define WS2812_PWM_TOP  20
+#define WS2812_PWM_BIT0 (0x8000 | 6)
+#define WS2812_PWM_BIT1 (0x8000 | 13)
+#define WS2812_PWM_IDLE (0x8000 | 0)
+
+#define WS2812_BITS_PER_PIXEL 24
+
+// latch requires the line to stay low for >= 280us (224 slots)
+#define WS2812_RESET_SLOTS 224
+
+uint16_t* ws2812EncodePixels(uint16_t* dst, const ColorRGB* pixels, uint16_t num, uint16_t scale);
+
+void ws2812EncodeIdle(uint16_t* dst, const uint16_t* end);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef MACRO_H
+#define MACRO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "flash.h"
+
+#define MACRO_NAME_LEN_MAX 16
+#define MACRO_STEP_NUM_MAX 48
+
+typedef enum
+{
+    MacroOpRGB,
+    MacroOpHSV,
+    MacroOpDelay
+} MacroOp;
+
+// delay steps hold milliseconds LE in args[0..1]; layout is stored in flash as is
+typedef struct
+{
+    uint8_t op;
+    uint8_t args[3];
+} MacroStep;
+
+void macroSetup(void);
+
+FlashRetCode macroStart(const char* name, uint8_t repeats);
+
+void macroStop(void);
+
+bool macroIsRunning(void);
+
+void macroProcessStep(void);
+
+#endif
@@ -10,7 +10,10 @@ typedef enum
 {
     FlashRetCodeSuccess,
     FlashRetCodeBeyondPage,
-    FlashRetCodeMetaNotFound
+    FlashRetCodeMetaNotFound,
+    FlashRetCodeBadCRC,
+    FlashRetCodeBadImage,
+    FlashRetCodeBadWrite
 } FlashRetCode;
 
 void flashSetup(bool force);
@@ -19,6 +22,10 @@ void flashSaveColorHSV(ColorHSV hsv);
 
 void flashLoadColorHSV(ColorHSV* hsv);
 
+void flashSaveBcastSeq(uint32_t seqMark);
+
+FlashRetCode flashLoadBcastSeq(uint32_t* seqMark);
+
 void flashSaveColorRGBNamed(ColorRGB rgb, const char* name);
 
 FlashRetCode flashLoadColorRGBNamed(ColorRGB* rgb, const char* mark);
@@ -27,4 +34,22 @@ FlashRetCode flashDeleteColorRGBNamed(const char* name);
 
 uint32_t flashRecordCountMeta(uint8_t pageIdx, Metadata metaRef);
 
+FlashRetCode flashSaveMacro(const char* name, const uint8_t* steps, uint8_t len);
+
+FlashRetCode flashLoadMacro(const char* name, uint8_t* steps, uint8_t* len);
+
+FlashRetCode flashDeleteMacro(const char* name);
+
+FlashRetCode flashRecordNext(uint8_t pageIdx, uint32_t* addr, uint16_t* len);
+
+// image holds a whole page and stays in use until flashImageCommit()
+FlashRetCode flashImageBegin(uint8_t pageIdx, uint8_t* image);
+
+FlashRetCode flashImageWrite(uint8_t pageIdx, uint16_t offset, const uint8_t* data, uint16_t len);
+
+FlashRetCode flashImageCommit(uint8_t pageIdx, uint16_t len, uint16_t crc);
+
+// releases a staged image without writing it, harmless when nothing is staged
+void flashImageAbort(void);
+
 #endif
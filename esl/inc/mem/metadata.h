@@ -9,6 +9,8 @@
 #define METADATA_TYPE_COLOR_HSV       0x20
 #define METADATA_TYPE_COLOR_RGB_NAMED 0x30
 #define METADATA_TYPE_COLOR_HSV_NAMED 0x40
+#define METADATA_TYPE_MACRO           0x50
+#define METADATA_TYPE_BCAST_SEQ       0x60
 #define METADATA_TYPE_NONE            0xf0
 
 #define METADATA_STATE_DELETED        0x00
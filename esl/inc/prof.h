@@ -0,0 +1,12 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+void profSetup(void);
+
+uint32_t profCycles(void);
+
+uint32_t profCyclesToUs(uint32_t cycles);
+
+#endif
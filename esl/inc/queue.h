@@ -2,6 +2,7 @@
 #define QUEUE_H
 
 #include "utils.h"
+#include "anim.h"
 
 typedef enum
 {
@@ -9,15 +10,33 @@ typedef enum
     EventSwitchPressed,
     EventSwitchPressedContinuous,
     EventSwitchReleased,
+    EventColorModify,
     EventChangeColorRGB,
-    EventChangeColorHSV
+    EventChangeColorHSV,
+    EventAnimStart,
+    EventAnimFrame,
+    EventCliLine,
+    EventStripCommit,
+    EventStripPixels,
+    EventMacroStep,
+    EventFadeColor,
+    EventAdvPhase
 } EventType;
 
-typedef union
+// a zero fade applies the color at once
+typedef struct
 {
-    uint8_t  num;
-    ColorRGB rgb;
     ColorHSV hsv;
+    uint16_t fadeMs;
+} ColorFade;
+
+typedef union
+{
+    uint8_t    num;
+    ColorRGB   rgb;
+    ColorHSV   hsv;
+    AnimParams anim;
+    ColorFade  fade;
 } EventData;
 
 typedef struct
@@ -26,6 +45,22 @@ typedef struct
     EventData data;
 } Event;
 
+#define QUEUE_SIZE UINT8_MAX
+
+// a zero-initialized queue is empty
+typedef struct
+{
+    Event   events[QUEUE_SIZE];
+    uint8_t idxF;
+    uint8_t idxR;
+} Queue;
+
+// a full queue drops the event
+void queueEnqueue(Queue* queue, Event event);
+
+Event queueDequeue(Queue* queue);
+
+// the application queue served by the main loop
 void queueEventEnqueue(Event event);
 
 Event queueEventDequeue(void);
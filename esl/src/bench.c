@@ -0,0 +1,170 @@
+#include <string.h>
+
+#include "bench.h"
+#include "prof.h"
+#include "queue.h"
+#include "leds.h"
+#include "strip.h"
+#include "wave.h"
+#include "utils.h"
+#include "flash.h"
+#include "parse.h"
+
+// name, prepare (runs untimed before every sample, may be NULL), body
+#define BENCH_CASES(X)                                          \
+    X("nop",             NULL,            benchNop)             \
+    X("hsv2rgb",         NULL,            benchHSV2RGB)         \
+    X("wave_sincos",     NULL,            benchWave)            \
+    X("parse_number",    NULL,            benchParse)           \
+    X("queue_roundtrip", NULL,            benchQueue)           \
+    BENCH_CASES_DEVICE(X)
+
+// cases driving peripherals or flash, left out of the host runner (BENCH_HOST)
+#ifdef BENCH_HOST
+#define BENCH_CASES_DEVICE(X)
+#else
+#define BENCH_CASES_DEVICE(X)                                   \
+    X("flash_load_hsv",  NULL,            benchFlashLoad)       \
+    X("leds_commit",     NULL,            benchLedsCommit)      \
+    X("strip_commit",    benchStripAwait, benchStripCommit)
+#endif
+
+typedef void (*BenchFunc)(void);
+
+typedef struct
+{
+    const char* name;
+    BenchFunc   prepare;
+    BenchFunc   body;
+} BenchCase;
+
+// results are written here so the compiler cannot drop the work
+static volatile uint32_t gBenchSink;
+
+static uint32_t gBenchIteration = 0;
+
+// a queue of its own, the application queue may hold pending events
+static Queue gBenchQueue;
+
+static void benchNop(void)
+{
+}
+
+static void benchHSV2RGB(void)
+{
+    ColorRGB rgb = hsv2rgb((ColorHSV){.h = gBenchIteration++, .s = 200, .v = 180});
+    gBenchSink = rgb.r + rgb.g + rgb.b;
+}
+
+static void benchWave(void)
+{
+    int16_t sinQ15;
+    int16_t cosQ15;
+    waveSinCosQ15(gBenchIteration++ * 0x01000193, &sinQ15, &cosQ15);
+    gBenchSink = sinQ15 + cosQ15;
+}
+
+static void benchParse(void)
+{
+    uint32_t value;
+    parseNumber("4096", UINT16_MAX, &value);
+    gBenchSink = value;
+}
+
+static void benchQueue(void)
+{
+    queueEnqueue(&gBenchQueue, (Event){EventAnimFrame});
+    gBenchSink = queueDequeue(&gBenchQueue).type;
+}
+
+#ifndef BENCH_HOST
+
+static void benchFlashLoad(void)
+{
+    ColorHSV hsv;
+    flashLoadColorHSV(&hsv);
+    gBenchSink = hsv.h;
+}
+
+static void benchLedsCommit(void)
+{
+    ledsSetLED2StateRGB(ledsGetLED2State());
+}
+
+static void benchStripAwait(void)
+{
+    while(stripIsBusy()){}
+}
+
+static void benchStripCommit(void)
+{
+    stripCommit();
+}
+
+#endif
+
+#define BENCH_CASE_ENTRY(name, prepare, body) {name, prepare, body},
+
+static const BenchCase gBenchCases[] =
+{
+    BENCH_CASES(BENCH_CASE_ENTRY)
+};
+
+#define BENCH_CASE_NUM (sizeof(gBenchCases) / sizeof(gBenchCases[0]))
+
+uint8_t benchGetNum(void)
+{
+    return BENCH_CASE_NUM;
+}
+
+const char* benchGetName(uint8_t idx)
+{
+    return idx < BENCH_CASE_NUM ? gBenchCases[idx].name : "";
+}
+
+uint8_t benchFind(const char* name)
+{
+    for(uint8_t idx = 0; idx < BENCH_CASE_NUM; ++idx)
+        if(strcmp(name, gBenchCases[idx].name) == 0)
+            return idx;
+    return BENCH_CASE_NUM;
+}
+
+// samples are raw DWT cycles (nanoseconds on the host, see host/prof.c) including the
+// profCycles() overhead, see the "nop" case
+void benchRun(uint8_t idx, uint8_t repeats, BenchResult* result)
+{
+    const BenchCase* bench = &gBenchCases[idx];
+    uint32_t         samples[BENCH_REPEATS_MAX];
+
+    if(repeats == 0)
+        repeats = 1;
+    if(repeats > BENCH_REPEATS_MAX)
+        repeats = BENCH_REPEATS_MAX;
+
+    for(uint8_t cnt = 0; cnt < BENCH_WARMUP + repeats; ++cnt)
+    {
+        if(bench->prepare != NULL)
+            bench->prepare();
+
+        uint32_t cycles = profCycles();
+        bench->body();
+        cycles = profCycles() - cycles;
+
+        if(cnt < BENCH_WARMUP)
+            continue;
+
+        // insertion keeps the samples sorted for the median
+        uint8_t pos = cnt - BENCH_WARMUP;
+        while(pos > 0 && samples[pos - 1] > cycles)
+        {
+            samples[pos] = samples[pos - 1];
+            --pos;
+        }
+        samples[pos] = cycles;
+    }
+
+    result->min    = samples[0];
+    result->median = samples[repeats / 2];
+    result->max    = samples[repeats - 1];
+}
@@ -0,0 +1,36 @@
+#include "advphase.h"
+
+// kept free of SDK dependencies so the phase transitions can be exercised on a host
+
+// reports and requests may be overtaken by a start from the main loop: the module's own moves
+// only count while it is still in that mode, a burst only starts from sleep
+AdvPhaseAction advPhaseNext(BLEAdvPhase current, BLEAdvPhase requested, AdvModuleMode mode)
+{
+    switch(requested)
+    {
+    case BLEAdvPhaseFast:
+        return AdvPhaseActionStart;
+
+    case BLEAdvPhaseSlow:
+        if(mode == AdvModuleSlow && current == BLEAdvPhaseFast)
+            return AdvPhaseActionEnter;
+        break;
+
+    case BLEAdvPhaseSleep:
+        if(mode == AdvModuleIdle && current != BLEAdvPhaseOff)
+            return AdvPhaseActionEnter;
+        break;
+
+    case BLEAdvPhaseBurst:
+        if(current == BLEAdvPhaseSleep)
+            return AdvPhaseActionStart;
+        break;
+
+    case BLEAdvPhaseOff:
+        return AdvPhaseActionEnter;
+
+    default:
+        break;
+    }
+    return AdvPhaseActionNone;
+}
@@ -0,0 +1,137 @@
+#include <string.h>
+
+#include "bcast.h"
+
+// kept free of SDK dependencies so the decoder and the dedup window can be exercised on a host
+
+#define BCAST_AD_TYPE_MANUF 0xFF
+
+// the MAC is AES-CBC-MAC over one block (company id, then the command body, zero padded),
+// a single fixed-length block needs no further chaining
+static void bcastMAC(const uint8_t* key, BcastCipher cipher, const uint8_t* body, uint8_t mac[BCAST_MAC_LEN])
+{
+    uint8_t block[BCAST_BLOCK_LEN] = {BCAST_COMPANY_ID & 0xFF, BCAST_COMPANY_ID >> 8};
+    uint8_t out[BCAST_BLOCK_LEN];
+
+    memcpy(&block[2], body, BCAST_BODY_LEN);
+    cipher(key, block, out);
+    memcpy(mac, out, BCAST_MAC_LEN);
+}
+
+// constant time, a mismatch position must not leak through timing
+static bool bcastMACEqual(const uint8_t* a, const uint8_t* b)
+{
+    uint8_t diff = 0;
+    for(uint8_t idx = 0; idx < BCAST_MAC_LEN; ++idx)
+        diff |= a[idx] ^ b[idx];
+    return diff == 0;
+}
+
+// walks the AD structures and returns the command payload past the company identifier
+static const uint8_t* bcastFind(const uint8_t* adv, uint16_t len)
+{
+    uint16_t pos = 0;
+    while(pos + 1 < len)
+    {
+        uint8_t fieldLen = adv[pos];
+        if(fieldLen == 0 || pos + 1 + fieldLen > len)
+            return NULL;
+
+        const uint8_t* field = &adv[pos + 1];
+        if(field[0] == BCAST_AD_TYPE_MANUF && fieldLen == 1 + 2 + BCAST_CMD_LEN &&
+           (field[1] | (field[2] << 8)) == BCAST_COMPANY_ID && field[3] == BCAST_VERSION)
+            return &field[3];
+
+        pos += 1 + fieldLen;
+    }
+    return NULL;
+}
+
+// sliding window over the newest sequence number, bit n marks seqTop - n as seen;
+// numbers older than the window are dropped as replays however far back they are, the sequence
+// does not wrap; a receiver that was never restored takes the first authentic number as it comes
+static bool bcastSeqAccept(BcastReceiver* rx, uint32_t seq)
+{
+    if(!rx->seqValid)
+    {
+        rx->seqValid = true;
+        rx->seqTop   = seq;
+        rx->seqSeen  = 1;
+        return true;
+    }
+
+    if(seq > rx->seqTop)
+    {
+        uint32_t ahead = seq - rx->seqTop;
+        rx->seqSeen  = ahead >= BCAST_WINDOW_LEN ? 0 : rx->seqSeen << ahead;
+        rx->seqSeen |= 1;
+        rx->seqTop   = seq;
+        return true;
+    }
+
+    uint32_t behind = rx->seqTop - seq;
+    if(behind >= BCAST_WINDOW_LEN || (rx->seqSeen & (1UL << behind)))
+        return false;
+
+    rx->seqSeen |= 1UL << behind;
+    return true;
+}
+
+void bcastReceiverInit(BcastReceiver* rx, const uint8_t* key, BcastCipher cipher, uint8_t group)
+{
+    memset(rx, 0, sizeof(*rx));
+    rx->key    = key;
+    rx->cipher = cipher;
+    rx->group  = group;
+}
+
+void bcastReceiverRestore(BcastReceiver* rx, uint32_t seqMark)
+{
+    rx->seqValid = true;
+    rx->seqTop   = seqMark;
+    rx->seqSeen  = UINT32_MAX;
+}
+
+// the window is only advanced by authentic commands for this receiver
+BcastResult bcastDecode(BcastReceiver* rx, const uint8_t* adv, uint16_t len, BcastCommand* cmd)
+{
+    const uint8_t* body = bcastFind(adv, len);
+    if(body == NULL)
+        return BcastResultNotCommand;
+
+    uint8_t mac[BCAST_MAC_LEN];
+    bcastMAC(rx->key, rx->cipher, body, mac);
+    if(!bcastMACEqual(mac, &body[BCAST_BODY_LEN]))
+        return BcastResultBadMAC;
+
+    cmd->group  = body[1];
+    cmd->seq    = body[2] | (body[3] << 8) | ((uint32_t)body[4] << 16) | ((uint32_t)body[5] << 24);
+    cmd->hsv.h  = body[6];
+    cmd->hsv.s  = body[7];
+    cmd->hsv.v  = body[8];
+    cmd->fadeMs = body[9] | (body[10] << 8);
+
+    if(cmd->group != BCAST_GROUP_ALL && cmd->group != rx->group)
+        return BcastResultOtherGroup;
+    if(!bcastSeqAccept(rx, cmd->seq))
+        return BcastResultDuplicate;
+    return BcastResultAccepted;
+}
+
+// builds the manufacturer data payload (without the company identifier), returns its length
+uint8_t bcastEncode(const uint8_t* key, BcastCipher cipher, const BcastCommand* cmd, uint8_t* dst)
+{
+    dst[0]  = BCAST_VERSION;
+    dst[1]  = cmd->group;
+    dst[2]  = cmd->seq & 0xFF;
+    dst[3]  = (cmd->seq >> 8) & 0xFF;
+    dst[4]  = (cmd->seq >> 16) & 0xFF;
+    dst[5]  = cmd->seq >> 24;
+    dst[6]  = cmd->hsv.h;
+    dst[7]  = cmd->hsv.s;
+    dst[8]  = cmd->hsv.v;
+    dst[9]  = cmd->fadeMs & 0xFF;
+    dst[10] = cmd->fadeMs >> 8;
+    bcastMAC(key, cipher, dst, &dst[BCAST_BODY_LEN]);
+    return BCAST_CMD_LEN;
+}
@@ -0,0 +1,222 @@
+#include <stdbool.h>
+
+#include "app_util_platform.h"
+#include "app_timer.h"
+#include "ble_conn_params.h"
+#include "nrf_sdh_ble.h"
+#include "nrf_log.h"
+
+#include "link.h"
+#include "service.h"
+
+#define LINK_CHECK_PERIOD_MS 1000
+
+#define LINK_CONN_NUM NRF_SDH_BLE_PERIPHERAL_LINK_COUNT
+
+#ifndef LINK_IDLE_TIMEOUT_MS
+#define LINK_IDLE_TIMEOUT_MS 10000
+#endif
+
+// timer ticks per second at the configured RTC prescaler
+#define LINK_TICK_FREQ (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
+
+// short interval for interactive use, long interval with latency once nobody talks to us;
+// the supervision timeout covers (1 + latency) * max interval twice over
+static ble_gap_conn_params_t gLinkParams[BLELinkRegimeNum] =
+{
+    [BLELinkRegimeActive] =
+    {
+        .min_conn_interval = MSEC_TO_UNITS(15, UNIT_1_25_MS),
+        .max_conn_interval = MSEC_TO_UNITS(30, UNIT_1_25_MS),
+        .slave_latency     = 0,
+        .conn_sup_timeout  = MSEC_TO_UNITS(4000, UNIT_10_MS)
+    },
+    [BLELinkRegimeIdle] =
+    {
+        .min_conn_interval = MSEC_TO_UNITS(400, UNIT_1_25_MS),
+        .max_conn_interval = MSEC_TO_UNITS(500, UNIT_1_25_MS),
+        .slave_latency     = 4,
+        .conn_sup_timeout  = MSEC_TO_UNITS(6000, UNIT_10_MS)
+    }
+};
+
+static const char* const gLinkRegimeNames[BLELinkRegimeNum] =
+{
+    [BLELinkRegimeNone]   = "disconnected",
+    [BLELinkRegimeActive] = "active",
+    [BLELinkRegimeIdle]   = "idle"
+};
+
+APP_TIMER_DEF(gTimerLink);
+
+static uint16_t      gLinkConns[LINK_CONN_NUM];
+static BLELinkRegime gLinkRegime        = BLELinkRegimeNone;
+static uint32_t      gLinkIdleTimeoutMs = LINK_IDLE_TIMEOUT_MS;
+static uint32_t      gLinkLastActivity  = 0;
+static uint32_t      gLinkStamp         = 0;
+static uint64_t      gLinkRegimeTicks[BLELinkRegimeNum];
+static uint32_t      gLinkTransitions   = 0;
+static uint16_t      gLinkInterval      = 0;
+static uint16_t      gLinkLatency       = 0;
+
+// the timer counter wraps after a few minutes, so elapsed time is folded in at least every check period
+static void bleLinkAccount(void)
+{
+    uint32_t now = app_timer_cnt_get();
+    gLinkRegimeTicks[gLinkRegime] += app_timer_cnt_diff_compute(now, gLinkStamp);
+    gLinkStamp = now;
+}
+
+// the regime is shared by all links, activity on any of them keeps every link active
+static uint8_t bleLinkConnSlot(uint16_t hconn)
+{
+    uint8_t idx = 0;
+    while(idx < LINK_CONN_NUM && gLinkConns[idx] != hconn)
+        ++idx;
+    return idx;
+}
+
+static uint8_t bleLinkConnCount(void)
+{
+    uint8_t count = 0;
+    for(uint8_t idx = 0; idx < LINK_CONN_NUM; ++idx)
+        count += gLinkConns[idx] != BLE_CONN_HANDLE_INVALID;
+    return count;
+}
+
+static void bleLinkRequest(BLELinkRegime regime)
+{
+    for(uint8_t idx = 0; idx < LINK_CONN_NUM; ++idx)
+        if(gLinkConns[idx] != BLE_CONN_HANDLE_INVALID)
+            ble_conn_params_change_conn_params(gLinkConns[idx], &gLinkParams[regime]);
+}
+
+// called from both the SoftDevice event handler and the timer, serialized by the critical region;
+// the central is free to reject the request, the outcome arrives as BLE_GAP_EVT_CONN_PARAM_UPDATE
+static void bleLinkSwitch(BLELinkRegime regime)
+{
+    bool changed = false;
+
+    CRITICAL_REGION_ENTER();
+    if(regime != gLinkRegime)
+    {
+        bleLinkAccount();
+        NRF_LOG_INFO("Link %s -> %s", gLinkRegimeNames[gLinkRegime], gLinkRegimeNames[regime]);
+        gLinkRegime = regime;
+        ++gLinkTransitions;
+        changed = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if(changed && regime != BLELinkRegimeNone)
+        bleLinkRequest(regime);
+}
+
+static void bleLinkActivity(void)
+{
+    gLinkLastActivity = app_timer_cnt_get();
+    if(gLinkRegime == BLELinkRegimeIdle)
+        bleLinkSwitch(BLELinkRegimeActive);
+}
+
+static void bleLinkHandlerCheck(void* p_context)
+{
+    CRITICAL_REGION_ENTER();
+    bleLinkAccount();
+    CRITICAL_REGION_EXIT();
+
+    if(gLinkRegime != BLELinkRegimeActive || bleServiceAttrHSVIsSubscribed())
+        return;
+
+    uint32_t idleTicks = app_timer_cnt_diff_compute(app_timer_cnt_get(), gLinkLastActivity);
+    if((uint64_t)idleTicks * 1000 / LINK_TICK_FREQ >= gLinkIdleTimeoutMs)
+        bleLinkSwitch(BLELinkRegimeIdle);
+}
+
+// must run before ble_conn_params_init, which picks up the preferred parameters set here
+void bleLinkSetup(void)
+{
+    sd_ble_gap_ppcp_set(&gLinkParams[BLELinkRegimeActive]);
+
+    for(uint8_t idx = 0; idx < LINK_CONN_NUM; ++idx)
+        gLinkConns[idx] = BLE_CONN_HANDLE_INVALID;
+
+    gLinkStamp = app_timer_cnt_get();
+    app_timer_create(&gTimerLink, APP_TIMER_MODE_REPEATED, bleLinkHandlerCheck);
+    app_timer_start(gTimerLink, APP_TIMER_TICKS(LINK_CHECK_PERIOD_MS), NULL);
+}
+
+// GATT writes and completed notifications count as activity, so does a new connection
+void bleLinkOnEvent(ble_evt_t const* evt)
+{
+    uint16_t hconn = evt->evt.gap_evt.conn_handle;
+    uint8_t  slot;
+
+    switch(evt->header.evt_id)
+    {
+    case BLE_GAP_EVT_CONNECTED:
+        slot = bleLinkConnSlot(BLE_CONN_HANDLE_INVALID);
+        if(slot < LINK_CONN_NUM)
+            gLinkConns[slot] = hconn;
+
+        gLinkInterval = evt->evt.gap_evt.params.connected.conn_params.max_conn_interval;
+        gLinkLatency  = evt->evt.gap_evt.params.connected.conn_params.slave_latency;
+        bleLinkActivity();
+        bleLinkSwitch(BLELinkRegimeActive);
+        break;
+
+    case BLE_GAP_EVT_DISCONNECTED:
+        slot = bleLinkConnSlot(hconn);
+        if(slot < LINK_CONN_NUM)
+            gLinkConns[slot] = BLE_CONN_HANDLE_INVALID;
+
+        if(bleLinkConnCount() == 0)
+            bleLinkSwitch(BLELinkRegimeNone);
+        break;
+
+    case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+        gLinkInterval = evt->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval;
+        gLinkLatency  = evt->evt.gap_evt.params.conn_param_update.conn_params.slave_latency;
+        NRF_LOG_INFO("Connection interval %u us, latency %u", gLinkInterval * 1250, gLinkLatency);
+        break;
+
+    case BLE_GATTS_EVT_WRITE:
+    case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+        bleLinkActivity();
+        break;
+
+    default:
+        break;
+    }
+}
+
+void bleLinkSetIdleTimeout(uint32_t timeoutMs)
+{
+    gLinkIdleTimeoutMs = timeoutMs;
+}
+
+BLELinkStats bleLinkGetStats(void)
+{
+    BLELinkStats stats =
+    {
+        .regime        = gLinkRegime,
+        .interval      = gLinkInterval,
+        .latency       = gLinkLatency,
+        .idleTimeoutMs = gLinkIdleTimeoutMs,
+        .transitions   = gLinkTransitions
+    };
+
+    CRITICAL_REGION_ENTER();
+    bleLinkAccount();
+    for(uint8_t regime = 0; regime < BLELinkRegimeNum; ++regime)
+        stats.regimeMs[regime] = gLinkRegimeTicks[regime] * 1000 / LINK_TICK_FREQ;
+    CRITICAL_REGION_EXIT();
+    return stats;
+}
+
+const char* bleLinkRegimeToName(BLELinkRegime regime)
+{
+    if(regime >= BLELinkRegimeNum)
+        return "";
+    return gLinkRegimeNames[regime];
+}
@@ -0,0 +1,149 @@
+#include <string.h>
+
+#include "nrf_soc.h"
+#include "nrf_log.h"
+#include "app_util_platform.h"
+
+#include "observer.h"
+#include "queue.h"
+#include "flash.h"
+
+static BLEObserverStats gObserverStats;
+
+#if BLE_OBSERVER_ENABLED
+
+#ifndef BLE_OBSERVER_GROUP
+#define BLE_OBSERVER_GROUP 1
+#endif
+
+// every installation has its own key, there is no default one to leave in a shipped build,
+// e.g. make SOFTDEVICE=s140 BLE_OBSERVER_KEY="{0x45, 0x53, ...}"
+#ifndef BLE_OBSERVER_KEY
+#error "BLE_OBSERVER_KEY is not set, the observer build needs the 16-byte key of the installation"
+#endif
+
+// passive, continuous scan; the SoftDevice interleaves it with advertising and connections
+#define OBSERVER_SCAN_INTERVAL MSEC_TO_UNITS(100, UNIT_0_625_MS)
+#define OBSERVER_SCAN_WINDOW   MSEC_TO_UNITS(100, UNIT_0_625_MS)
+
+// sequence numbers persisted ahead of the newest accepted one, a steady sender costs one flash
+// write per this many commands and a reboot skips at most this many
+#define OBSERVER_SEQ_RESERVE 64
+
+static const uint8_t gObserverKey[BCAST_KEY_LEN] = BLE_OBSERVER_KEY;
+
+static const ble_gap_scan_params_t gObserverScanParams =
+{
+    .active        = 0,
+    .filter_policy = BLE_GAP_SCAN_FP_ACCEPT_ALL,
+    .scan_phys     = BLE_GAP_PHY_1MBPS,
+    .interval      = OBSERVER_SCAN_INTERVAL,
+    .window        = OBSERVER_SCAN_WINDOW,
+    .timeout       = BLE_GAP_SCAN_TIMEOUT_UNLIMITED
+};
+
+static uint8_t          gObserverScanData[BLE_GAP_SCAN_BUFFER_MIN];
+static const ble_data_t gObserverScanBuffer =
+{
+    .p_data = gObserverScanData,
+    .len    = sizeof(gObserverScanData)
+};
+
+static BcastReceiver gObserverRx;
+
+// the high-water mark as last written to flash, a reboot resumes past it instead of accepting
+// whatever authentic command comes first, replays included
+static bool     gObserverMarkSaved = false;
+static uint32_t gObserverSeqMark   = 0;
+
+static void bleObserverCipher(const uint8_t key[BCAST_KEY_LEN], const uint8_t in[BCAST_BLOCK_LEN],
+                              uint8_t out[BCAST_BLOCK_LEN])
+{
+    nrf_ecb_hal_data_t ecb;
+    memcpy(ecb.key, key, BCAST_KEY_LEN);
+    memcpy(ecb.cleartext, in, BCAST_BLOCK_LEN);
+    sd_ecb_block_encrypt(&ecb);
+    memcpy(out, ecb.ciphertext, BCAST_BLOCK_LEN);
+}
+
+void bleObserverSetup(void)
+{
+    bcastReceiverInit(&gObserverRx, gObserverKey, bleObserverCipher, BLE_OBSERVER_GROUP);
+    gObserverMarkSaved = flashLoadBcastSeq(&gObserverSeqMark) == FlashRetCodeSuccess;
+    if(gObserverMarkSaved)
+        bcastReceiverRestore(&gObserverRx, gObserverSeqMark);
+    gObserverStats.group = BLE_OBSERVER_GROUP;
+    sd_ble_gap_scan_start(&gObserverScanParams, &gObserverScanBuffer);
+    NRF_LOG_INFO("Observing group %u", BLE_OBSERVER_GROUP);
+}
+
+// the scanner pauses after every report until it is handed the buffer again
+void bleObserverOnEvent(ble_evt_t const* evt)
+{
+    if(evt->header.evt_id != BLE_GAP_EVT_ADV_REPORT)
+        return;
+
+    const ble_gap_evt_adv_report_t* report = &evt->evt.gap_evt.params.adv_report;
+    BcastCommand cmd;
+    BcastResult  result = bcastDecode(&gObserverRx, report->data.p_data, report->data.len, &cmd);
+
+    ++gObserverStats.reports;
+    ++gObserverStats.results[result];
+    if(result == BcastResultAccepted)
+        queueEventEnqueue((Event){EventFadeColor, {.fade = {cmd.hsv, cmd.fadeMs}}});
+
+    sd_ble_gap_scan_start(NULL, &gObserverScanBuffer);
+}
+
+void bleObserverSetGroup(uint8_t group)
+{
+    gObserverRx.group    = group;
+    gObserverStats.group = group;
+}
+
+// main loop only, flash writes wait for SoftDevice events that the scan report handler would block;
+// the mark is only moved once an accepted number passes it
+void bleObserverPersist(void)
+{
+    bool     seqValid;
+    uint32_t seqTop;
+
+    CRITICAL_REGION_ENTER();
+    seqValid = gObserverRx.seqValid;
+    seqTop   = gObserverRx.seqTop;
+    CRITICAL_REGION_EXIT();
+
+    if(!seqValid || (gObserverMarkSaved && seqTop <= gObserverSeqMark))
+        return;
+
+    gObserverSeqMark   = seqTop > UINT32_MAX - OBSERVER_SEQ_RESERVE ? UINT32_MAX : seqTop + OBSERVER_SEQ_RESERVE;
+    gObserverMarkSaved = true;
+    flashSaveBcastSeq(gObserverSeqMark);
+}
+
+#else
+
+// the S113 build keeps the interface so callers need no conditionals
+
+void bleObserverSetup(void)
+{
+}
+
+void bleObserverOnEvent(ble_evt_t const* evt)
+{
+}
+
+void bleObserverSetGroup(uint8_t group)
+{
+}
+
+void bleObserverPersist(void)
+{
+}
+
+#endif
+
+BLEObserverStats bleObserverGetStats(void)
+{
+    return gObserverStats;
+}
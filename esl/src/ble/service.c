@@ -1,103 +1,654 @@
 #include "app_error.h"
+#include "app_util_platform.h"
 #include "nrf_log.h"
 
 #include "ble.h"
 #include "ble_gatts.h"
 #include "ble_srv_common.h"
+#include "nrf_sdh_ble.h"
+#include "app_timer.h"
 
 #include "service.h"
 #include "utils.h"
+#include "power.h"
+#include "queue.h"
+#include "anim.h"
 
 #define UUID_ATTR1 0x0001
 #define UUID_ATTR2 0x0002
+#define UUID_ATTR3 0x0003
+#define UUID_ATTR4 0x0004
+#define UUID_ATTR5 0x0005
+#define UUID_ATTR6 0x0006
+#define UUID_ATTR7 0x0007
+
+// effect id followed by little-endian period in ms
+#define ATTR_EFFECT_LEN 3
+
+// characteristic properties, write without response is WRITE_NR
+#define ATTR_PROP_READ     0x01
+#define ATTR_PROP_WRITE    0x02
+#define ATTR_PROP_WRITE_NR 0x04
+#define ATTR_PROP_NOTIFY   0x08
+
+// frame write header: timestamp u16, interval u8
+#define ATTR_FRAME_HEADER_LEN 3
+#define ATTR_FRAME_COLOR_NUM_MAX ((NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3 - ATTR_FRAME_HEADER_LEN) / sizeof(ColorRGB))
+
+// bulk chunks carry a little-endian sequence number followed by data, one chunk per ATT PDU
+#define ATTR_BULK_LEN_MAX (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+#define ATTR_BULK_SEQ_LEN 2
 
 static const ble_uuid128_t gUUID =
 {
     .uuid128 = UUID_BLE_SERVICE_BASE
 };
 
+#define BLE_PEER_NUM NRF_SDH_BLE_PERIPHERAL_LINK_COUNT
+
+// per-connection state, a slot is free while hconn is invalid; written from the SoftDevice
+// event handler and read from the main loop inside critical regions
+typedef struct
+{
+    uint16_t hconn;
+    uint16_t mtu;
+    uint8_t  dataLength;
+    uint8_t  phy;
+    bool     hsvSubscribed;
+    bool     hsvDirty;
+    uint8_t  hvxQueued;
+    uint8_t  hsvQueuedAt;
+    bool     bulkSubscribed;
+} BLEPeer;
+
 static BLEService gService;
 
-static BLEAttr          gAttrHSVDesc;
-static ble_gatts_attr_t gAttrHSV;
+static BLEPeer gPeers[BLE_PEER_NUM];
+
+typedef void (*BLEAttrOnWrite)(BLEPeer* peer, ble_gatts_evt_write_t const* write);
+typedef void (*BLEAttrOnSubscribe)(BLEPeer* peer, bool enabled);
+
+typedef struct
+{
+    uint16_t           uuid;
+    uint8_t            props;
+    uint8_t            vloc;
+    uint16_t           initLen;
+    uint16_t           maxLen;
+    BLEAttrOnWrite     onWrite;
+    BLEAttrOnSubscribe onSubscribe;
+} BLEAttrDesc;
+
+static void bleServiceOnWriteInput(BLEPeer* peer, ble_gatts_evt_write_t const* write);
+static void bleServiceOnWriteEffect(BLEPeer* peer, ble_gatts_evt_write_t const* write);
+static void bleServiceOnWriteFrame(BLEPeer* peer, ble_gatts_evt_write_t const* write);
+static void bleServiceOnWriteBulk(BLEPeer* peer, ble_gatts_evt_write_t const* write);
+static void bleServiceOnSubscribeHSV(BLEPeer* peer, bool enabled);
+static void bleServiceOnSubscribeBulk(BLEPeer* peer, bool enabled);
+
+// HSV notifications are coalesced per peer: at most one is queued in the SoftDevice at a time,
+// later changes only mark the value dirty and go out with HVN_TX_COMPLETE;
+// the SoftDevice sends notifications of a connection in order, so the HSV one is done once
+// as many completions as there were notifications queued up to and including it have arrived;
+// the value is encoded once per change and shared by all peers and by reads
+static const ColorHSV* gHSVSource = NULL;
+static ColorHSV        gHSVValue;
+static BLENotifyStats  gNotifyStats;
+
+// name, UUID, properties, value location, user value (stack values: NULL), initial and maximum length,
+// write and CCCD handlers; values shorter than their maximum are variable length;
+// characteristics are added in this order, appending keeps existing handles stable
+#define ATTR_TABLE(X)                                                                                     \
+    X(HSV,     UUID_ATTR1, ATTR_PROP_READ | ATTR_PROP_NOTIFY, BLE_GATTS_VLOC_USER,  &gHSVValue,           \
+      sizeof(ColorHSV),       sizeof(ColorHSV),       NULL,                    bleServiceOnSubscribeHSV)  \
+    X(Input,   UUID_ATTR2, ATTR_PROP_WRITE,                   BLE_GATTS_VLOC_STACK, NULL,                 \
+      sizeof(ColorHSV),       sizeof(ColorHSV),       bleServiceOnWriteInput,  NULL)                      \
+    X(Effect,  UUID_ATTR3, ATTR_PROP_WRITE,                   BLE_GATTS_VLOC_STACK, NULL,                 \
+      ATTR_EFFECT_LEN,        ATTR_EFFECT_LEN,        bleServiceOnWriteEffect, NULL)                      \
+    X(Power,   UUID_ATTR4, ATTR_PROP_READ,                    BLE_GATTS_VLOC_USER,  powerGetTelemetry(),  \
+      sizeof(PowerTelemetry), sizeof(PowerTelemetry), NULL,                    NULL)                      \
+    X(BulkIn,  UUID_ATTR5, ATTR_PROP_WRITE_NR,                BLE_GATTS_VLOC_STACK, NULL,                 \
+      0,                      ATTR_BULK_LEN_MAX,      bleServiceOnWriteBulk,   NULL)                      \
+    X(BulkOut, UUID_ATTR6, ATTR_PROP_NOTIFY,                  BLE_GATTS_VLOC_STACK, NULL,                 \
+      0,                      ATTR_BULK_LEN_MAX,      NULL,                    bleServiceOnSubscribeBulk) \
+    X(Frame,   UUID_ATTR7, ATTR_PROP_WRITE_NR,                BLE_GATTS_VLOC_STACK, NULL,                 \
+      0,                      ATTR_BULK_LEN_MAX,      bleServiceOnWriteFrame,  NULL)
+
+#define ATTR_ID(name, uuid, props, vloc, value, initLen, maxLen, onWrite, onSubscribe) BLEAttr##name,
+#define ATTR_DESC(name, uuid, props, vloc, value, initLen, maxLen, onWrite, onSubscribe) \
+    [BLEAttr##name] = {uuid, props, vloc, initLen, maxLen, onWrite, onSubscribe},
+#define ATTR_VALUE(name, uuid, props, vloc, value, initLen, maxLen, onWrite, onSubscribe) \
+    [BLEAttr##name] = (uint8_t*)(value),
+
+typedef enum
+{
+    ATTR_TABLE(ATTR_ID)
+    BLEAttrNum
+} BLEAttrId;
+
+static const BLEAttrDesc gAttrDescs[BLEAttrNum] =
+{
+    ATTR_TABLE(ATTR_DESC)
+};
+
+static ble_gatts_char_handles_t gAttrHandles[BLEAttrNum];
 
-static BLEAttr          gAttrInputDesc;
-static ble_gatts_attr_t gAttrInput;
+// one bulk run at a time, sent to the first peer subscribed to bulk-out
+static BLEBulkStats   gBulkStats;
+static BLEPeer*       gBulkPeer       = NULL;
+static uint16_t       gBulkRxSeq      = 0;
+static uint32_t       gBulkRxStart    = 0;
+static uint32_t       gBulkRxTicks    = 0;
+static uint32_t       gBulkTxRemain   = 0;
+static uint16_t       gBulkTxSeq      = 0;
+static uint32_t       gBulkTxStart    = 0;
+static uint32_t       gBulkTxTicks    = 0;
+static uint8_t        gBulkTxChunk[ATTR_BULK_LEN_MAX];
+static bool           gBulkPumping    = false;
+static bool           gBulkPumpAgain  = false;
+
+static void bleServicePeerReset(BLEPeer* peer, uint16_t hconn)
+{
+    memset(peer, 0, sizeof(*peer));
+    peer->hconn      = hconn;
+    peer->mtu        = BLE_GATT_ATT_MTU_DEFAULT;
+    peer->dataLength = 27;
+    peer->phy        = BLE_GAP_PHY_1MBPS;
+}
+
+static BLEPeer* bleServicePeerFind(uint16_t hconn)
+{
+    for(uint8_t idx = 0; idx < BLE_PEER_NUM; ++idx)
+        if(gPeers[idx].hconn == hconn)
+            return &gPeers[idx];
+    return NULL;
+}
+
+static ret_code_t bleServiceAttrAdd(BLEAttrId id, uint8_t* value)
+{
+    const BLEAttrDesc* desc = &gAttrDescs[id];
+
+    ble_uuid_t uuid =
+    {
+        .uuid = desc->uuid,
+        .type = gService.uuid.type
+    };
+
+    ble_gatts_char_md_t charmd;
+    memset(&charmd, 0, sizeof(charmd));
+    charmd.char_props.read          = (desc->props & ATTR_PROP_READ) != 0;
+    charmd.char_props.write         = (desc->props & ATTR_PROP_WRITE) != 0;
+    charmd.char_props.write_wo_resp = (desc->props & ATTR_PROP_WRITE_NR) != 0;
+    charmd.char_props.notify        = (desc->props & ATTR_PROP_NOTIFY) != 0;
+
+    ble_gatts_attr_md_t attrmd;
+    memset(&attrmd, 0, sizeof(attrmd));
+    attrmd.vloc = desc->vloc;
+    attrmd.vlen = desc->initLen != desc->maxLen;
+    if(desc->props & ATTR_PROP_READ)
+        BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attrmd.read_perm);
+    if(desc->props & (ATTR_PROP_WRITE | ATTR_PROP_WRITE_NR))
+        BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attrmd.write_perm);
+
+    ble_gatts_attr_t attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.p_uuid    = &uuid;
+    attr.p_attr_md = &attrmd;
+    attr.init_len  = desc->initLen;
+    attr.max_len   = desc->maxLen;
+    attr.p_value   = value;
+
+    return sd_ble_gatts_characteristic_add(gService.hserv, &charmd, &attr, &gAttrHandles[id]);
+}
 
-ret_code_t bleServiceSetup(void)
+// the vendor base is registered once and shared by the service and all characteristics;
+// HSV reads are served from the encoded copy, hsv is only sampled by bleServiceAttrHSVNotify
+ret_code_t bleServiceSetup(const ColorHSV* hsv)
 {
+    for(uint8_t idx = 0; idx < BLE_PEER_NUM; ++idx)
+        bleServicePeerReset(&gPeers[idx], BLE_CONN_HANDLE_INVALID);
+
+    gHSVSource = hsv;
+    gHSVValue  = *hsv;
+
     memset(&gService, 0, sizeof(gService));
     gService.uuid.uuid = UUID_BLE_SERVICE_SHRT;
-    gService.uuid.type = BLE_UUID_TYPE_VENDOR_BEGIN;
 
     ret_code_t errCode;
     errCode = sd_ble_uuid_vs_add(&gUUID, &gService.uuid.type);
     VERIFY_SUCCESS(errCode);
     errCode = sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &gService.uuid, &gService.hserv);
     VERIFY_SUCCESS(errCode);
+
+    uint8_t* const values[BLEAttrNum] =
+    {
+        ATTR_TABLE(ATTR_VALUE)
+    };
+    for(uint8_t id = 0; id < BLEAttrNum; ++id)
+    {
+        errCode = bleServiceAttrAdd(id, values[id]);
+        VERIFY_SUCCESS(errCode);
+    }
     return NRF_SUCCESS;
 }
 
-ret_code_t bleServiceAttrHSVSetup(ColorHSV* ptr)
+// a notification that could not be queued gives its reserved place back
+static void bleServicePeerUnreserve(BLEPeer* peer)
 {
-    memset(&gAttrHSVDesc, 0, sizeof(gAttrHSVDesc));
-    gAttrHSVDesc.uuid.uuid                = UUID_ATTR1;
-    gAttrHSVDesc.uuid.type                = BLE_UUID_TYPE_VENDOR_BEGIN;
-    gAttrHSVDesc.charmd.char_props.read   = 1;
-    gAttrHSVDesc.charmd.char_props.notify = 1;
-    gAttrHSVDesc.attrmd.vloc              = BLE_GATTS_VLOC_USER;
-    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&gAttrHSVDesc.attrmd.read_perm);
-
-    memset(&gAttrHSV, 0, sizeof(gAttrHSV));
-    gAttrHSV.p_uuid    = &gAttrHSVDesc.uuid;
-    gAttrHSV.p_attr_md = &gAttrHSVDesc.attrmd;
-    gAttrHSV.init_len  = sizeof(*ptr);
-    gAttrHSV.max_len   = sizeof(*ptr);
-    gAttrHSV.p_value   = (uint8_t*)ptr;
-
-    ret_code_t errCode;
-    errCode = sd_ble_uuid_vs_add(&gUUID, &gAttrHSVDesc.uuid.type);
-    VERIFY_SUCCESS(errCode);
-    errCode = sd_ble_gatts_characteristic_add(gService.hserv, &gAttrHSVDesc.charmd, &gAttrHSV, &gAttrHSVDesc.handles);
-    VERIFY_SUCCESS(errCode);
-    return NRF_SUCCESS;
+    if(peer->hvxQueued > 0)
+        --peer->hvxQueued;
 }
 
-ret_code_t bleServiceAttrHSVNotify(void)
+// the value is read from the user location when the notification is queued,
+// so a coalesced change is never sent stale; the place in the SoftDevice queue is reserved
+// under the lock and the SVC call is made outside it, a flush from the other context finds
+// the place taken and leaves it alone
+static void bleServiceAttrHSVFlush(BLEPeer* peer)
 {
+    uint16_t hconn = BLE_CONN_HANDLE_INVALID;
+
+    CRITICAL_REGION_ENTER();
+    if(peer->hsvDirty && peer->hsvQueuedAt == 0 && peer->hconn != BLE_CONN_HANDLE_INVALID)
+    {
+        hconn             = peer->hconn;
+        peer->hsvQueuedAt = ++peer->hvxQueued;
+        peer->hsvDirty    = false;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if(hconn == BLE_CONN_HANDLE_INVALID)
+        return;
+
+    uint16_t len = sizeof(gHSVValue);
+
     ble_gatts_hvx_params_t params;
     memset(&params, 0, sizeof(params));
-    params.handle = gAttrHSVDesc.handles.value_handle;
+    params.handle = gAttrHandles[BLEAttrHSV].value_handle;
     params.type   = BLE_GATT_HVX_NOTIFICATION;
-    params.p_len  = &gAttrHSV.init_len;
-    return sd_ble_gatts_hvx(gService.hconn, &params);
+    params.p_len  = &len;
+
+    ret_code_t errCode = sd_ble_gatts_hvx(hconn, &params);
+
+    CRITICAL_REGION_ENTER();
+    if(errCode == NRF_SUCCESS)
+        ++gNotifyStats.sent;
+    else if(peer->hconn == hconn)
+    {
+        bleServicePeerUnreserve(peer);
+        peer->hsvQueuedAt = 0;
+        // a full queue is retried from HVN_TX_COMPLETE; anything else, e.g. notifications
+        // not enabled by the peer, would fail again
+        if(errCode == NRF_ERROR_RESOURCES)
+            peer->hsvDirty = true;
+        else
+            ++gNotifyStats.failed;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+// encodes the value once and fans it out, peers without a subscription never reach the SoftDevice
+ret_code_t bleServiceAttrHSVNotify(void)
+{
+    uint8_t subscribers = 0;
+
+    CRITICAL_REGION_ENTER();
+    gHSVValue = *gHSVSource;
+    for(uint8_t idx = 0; idx < BLE_PEER_NUM; ++idx)
+    {
+        BLEPeer* peer = &gPeers[idx];
+        if(peer->hconn == BLE_CONN_HANDLE_INVALID || !peer->hsvSubscribed)
+            continue;
+
+        ++subscribers;
+        if(peer->hsvDirty)
+            ++gNotifyStats.coalesced;
+        peer->hsvDirty = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if(subscribers == 0)
+    {
+        ++gNotifyStats.avoided;
+        return NRF_SUCCESS;
+    }
+
+    for(uint8_t idx = 0; idx < BLE_PEER_NUM; ++idx)
+        bleServiceAttrHSVFlush(&gPeers[idx]);
+    return NRF_SUCCESS;
 }
 
-uint32_t bleServiceAttrHSVGetHandle(void)
+BLENotifyStats bleServiceGetNotifyStats(void)
 {
-    return gAttrInputDesc.handles.value_handle;
+    return gNotifyStats;
 }
 
-ret_code_t bleServiceAttrInputSetup(ColorHSV* ptr)
+static void bleServiceBulkPump(void);
+
+static BLEPeer* bleServiceBulkPeer(void)
 {
-    memset(&gAttrInputDesc, 0, sizeof(gAttrInputDesc));
-    gAttrInputDesc.uuid.uuid               = UUID_ATTR2;
-    gAttrInputDesc.uuid.type               = BLE_UUID_TYPE_VENDOR_BEGIN;
-    gAttrInputDesc.charmd.char_props.write = 1;
-    gAttrInputDesc.attrmd.vloc             = BLE_GATTS_VLOC_STACK;
-    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&gAttrInputDesc.attrmd.write_perm);
+    for(uint8_t idx = 0; idx < BLE_PEER_NUM; ++idx)
+        if(gPeers[idx].hconn != BLE_CONN_HANDLE_INVALID && gPeers[idx].bulkSubscribed)
+            return &gPeers[idx];
+    return NULL;
+}
 
-    memset(&gAttrInput, 0, sizeof(gAttrInput));
-    gAttrInput.p_uuid    = &gAttrInputDesc.uuid;
-    gAttrInput.p_attr_md = &gAttrInputDesc.attrmd;
-    gAttrInput.init_len  = sizeof(*ptr);
-    gAttrInput.max_len   = sizeof(*ptr);
-    gAttrInput.p_value   = (uint8_t*)ptr;
+static void bleServiceOnWriteBulk(BLEPeer* peer, ble_gatts_evt_write_t const* write)
+{
+    if(write->len < ATTR_BULK_SEQ_LEN)
+        return;
 
-    ret_code_t errCode;
-    errCode = sd_ble_uuid_vs_add(&gUUID, &gAttrInputDesc.uuid.type);
-    VERIFY_SUCCESS(errCode);
-    errCode = sd_ble_gatts_characteristic_add(gService.hserv, &gAttrInputDesc.charmd, &gAttrInput, &gAttrInputDesc.handles);
-    VERIFY_SUCCESS(errCode);
-    return NRF_SUCCESS;
+    // sequence 0 starts a new measurement
+    uint16_t seq = write->data[0] | (write->data[1] << 8);
+    if(seq == 0)
+    {
+        gBulkStats.rxBytes     = 0;
+        gBulkStats.rxChunks    = 0;
+        gBulkStats.rxSeqErrors = 0;
+        gBulkRxStart           = app_timer_cnt_get();
+    }
+    else if(seq != gBulkRxSeq)
+        ++gBulkStats.rxSeqErrors;
+
+    gBulkRxSeq   = seq + 1;
+    gBulkRxTicks = app_timer_cnt_diff_compute(app_timer_cnt_get(), gBulkRxStart);
+    gBulkStats.rxBytes += write->len - ATTR_BULK_SEQ_LEN;
+    ++gBulkStats.rxChunks;
+}
+
+static void bleServiceOnWriteInput(BLEPeer* peer, ble_gatts_evt_write_t const* write)
+{
+    if(write->len != sizeof(ColorHSV))
+        return;
+
+    Event event =
+    {
+        .type     = EventChangeColorHSV,
+        .data.hsv =
+        {
+            .h = write->data[0],
+            .s = write->data[1],
+            .v = write->data[2]
+        }
+    };
+    queueEventEnqueue(event);
+    NRF_LOG_INFO("Queued color change by BLE");
+}
+
+static void bleServiceOnWriteEffect(BLEPeer* peer, ble_gatts_evt_write_t const* write)
+{
+    if(write->len < ATTR_EFFECT_LEN)
+        return;
+
+    Event event =
+    {
+        .type      = EventAnimStart,
+        .data.anim =
+        {
+            .effect   = write->data[0],
+            .periodMs = write->data[1] | (write->data[2] << 8)
+        }
+    };
+    queueEventEnqueue(event);
+    NRF_LOG_INFO("Queued effect change by BLE");
+}
+
+// little-endian u16 timestamp in ms, u8 interval in ms, then r g b per color;
+// frames arrive at connection event rate, they are kept out of the log
+static void bleServiceOnWriteFrame(BLEPeer* peer, ble_gatts_evt_write_t const* write)
+{
+    if(write->len < ATTR_FRAME_HEADER_LEN + sizeof(ColorRGB) || (write->len - ATTR_FRAME_HEADER_LEN) % sizeof(ColorRGB) != 0)
+        return;
+
+    ColorRGB colors[ATTR_FRAME_COLOR_NUM_MAX];
+    uint8_t  num = (write->len - ATTR_FRAME_HEADER_LEN) / sizeof(ColorRGB);
+    if(num > ATTR_FRAME_COLOR_NUM_MAX)
+        return;
+
+    const uint8_t* data = &write->data[ATTR_FRAME_HEADER_LEN];
+    for(uint8_t idx = 0; idx < num; ++idx, data += sizeof(ColorRGB))
+        colors[idx] = (ColorRGB){.r = data[0], .g = data[1], .b = data[2]};
+
+    animStreamPush(write->data[0] | (write->data[1] << 8), write->data[2], colors, num);
+}
+
+// a fresh subscriber gets the current value right away
+static void bleServiceOnSubscribeHSV(BLEPeer* peer, bool enabled)
+{
+    peer->hsvSubscribed = enabled;
+    if(enabled)
+    {
+        peer->hsvDirty = true;
+        bleServiceAttrHSVFlush(peer);
+    }
+}
+
+static void bleServiceOnSubscribeBulk(BLEPeer* peer, bool enabled)
+{
+    peer->bulkSubscribed = enabled;
+}
+
+// routes a write to the handler of the characteristic owning the value or CCCD handle;
+// characteristics without a CCCD have it invalid (0), which no write carries
+static void bleServiceOnWrite(BLEPeer* peer, ble_gatts_evt_write_t const* write)
+{
+    for(uint8_t id = 0; id < BLEAttrNum; ++id)
+    {
+        const BLEAttrDesc* desc = &gAttrDescs[id];
+        if(write->handle == gAttrHandles[id].value_handle)
+        {
+            if(desc->onWrite != NULL)
+                desc->onWrite(peer, write);
+            return;
+        }
+
+        if(write->handle == gAttrHandles[id].cccd_handle)
+        {
+            if(desc->onSubscribe != NULL && write->len == 2)
+                desc->onSubscribe(peer, (write->data[0] & BLE_GATT_HVX_NOTIFICATION) != 0);
+            return;
+        }
+    }
+}
+
+// completions count HSV and bulk notifications alike, only those ahead of the HSV one retire it
+static void bleServiceOnTxComplete(BLEPeer* peer, uint8_t count)
+{
+    CRITICAL_REGION_ENTER();
+    peer->hvxQueued   = peer->hvxQueued > count ? peer->hvxQueued - count : 0;
+    peer->hsvQueuedAt = peer->hsvQueuedAt > count ? peer->hsvQueuedAt - count : 0;
+    CRITICAL_REGION_EXIT();
+}
+
+void bleServiceOnEvent(ble_evt_t const* evt)
+{
+    BLEPeer* peer;
+
+    if(evt->header.evt_id == BLE_GAP_EVT_CONNECTED)
+    {
+        // the SoftDevice never connects more peripherals than there are slots
+        peer = bleServicePeerFind(BLE_CONN_HANDLE_INVALID);
+        if(peer != NULL)
+            bleServicePeerReset(peer, evt->evt.gap_evt.conn_handle);
+        return;
+    }
+
+    // GAP and GATTS events share the position of conn_handle
+    peer = bleServicePeerFind(evt->evt.gap_evt.conn_handle);
+    if(peer == NULL)
+        return;
+
+    switch(evt->header.evt_id)
+    {
+    case BLE_GAP_EVT_DISCONNECTED:
+        if(gBulkPeer == peer)
+        {
+            gBulkPeer     = NULL;
+            gBulkTxRemain = 0;
+        }
+        bleServicePeerReset(peer, BLE_CONN_HANDLE_INVALID);
+        break;
+
+    case BLE_GAP_EVT_PHY_UPDATE:
+        peer->phy = evt->evt.gap_evt.params.phy_update.tx_phy;
+        break;
+
+    case BLE_GATTS_EVT_WRITE:
+        bleServiceOnWrite(peer, &evt->evt.gatts_evt.params.write);
+        break;
+
+    case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+        bleServiceOnTxComplete(peer, evt->evt.gatts_evt.params.hvn_tx_complete.count);
+        bleServiceAttrHSVFlush(peer);
+        if(gBulkPeer == peer)
+            bleServiceBulkPump();
+        break;
+
+    default:
+        break;
+    }
+}
+
+bool bleServiceAttrHSVIsSubscribed(void)
+{
+    for(uint8_t idx = 0; idx < BLE_PEER_NUM; ++idx)
+        if(gPeers[idx].hconn != BLE_CONN_HANDLE_INVALID && gPeers[idx].hsvSubscribed)
+            return true;
+    return false;
+}
+
+// keeps the SoftDevice notification queue full until the transfer is done, refilled from
+// HVN_TX_COMPLETE; only the bookkeeping runs under the lock, one chunk at a time, and the SVC
+// calls run outside it; a pump entered while another one runs leaves it a note to go on
+static void bleServiceBulkPump(void)
+{
+    bool running;
+
+    CRITICAL_REGION_ENTER();
+    running        = gBulkPumping;
+    gBulkPumping   = true;
+    gBulkPumpAgain = running;
+    CRITICAL_REGION_EXIT();
+
+    if(running)
+        return;
+
+    while(true)
+    {
+        BLEPeer* peer = NULL;
+        uint16_t len  = 0;
+        uint16_t seq  = 0;
+
+        CRITICAL_REGION_ENTER();
+        gBulkPumpAgain = false;
+        if(gBulkTxRemain > 0 && gBulkPeer != NULL && gBulkPeer->bulkSubscribed)
+        {
+            peer = gBulkPeer;
+            seq  = gBulkTxSeq;
+            len  = peer->mtu - 3;
+            if(len > ATTR_BULK_LEN_MAX)
+                len = ATTR_BULK_LEN_MAX;
+            if(len - ATTR_BULK_SEQ_LEN > gBulkTxRemain)
+                len = ATTR_BULK_SEQ_LEN + gBulkTxRemain;
+            ++peer->hvxQueued;
+        }
+        else
+            gBulkPumping = false;
+        CRITICAL_REGION_EXIT();
+
+        if(peer == NULL)
+            return;
+
+        gBulkTxChunk[0] = seq & 0xFF;
+        gBulkTxChunk[1] = seq >> 8;
+        for(uint16_t idx = ATTR_BULK_SEQ_LEN; idx < len; ++idx)
+            gBulkTxChunk[idx] = seq + idx;
+
+        ble_gatts_hvx_params_t params;
+        memset(&params, 0, sizeof(params));
+        params.handle = gAttrHandles[BLEAttrBulkOut].value_handle;
+        params.type   = BLE_GATT_HVX_NOTIFICATION;
+        params.p_len  = &len;
+        params.p_data = gBulkTxChunk;
+
+        ret_code_t errCode = sd_ble_gatts_hvx(peer->hconn, &params);
+
+        bool stop = false;
+        CRITICAL_REGION_ENTER();
+        if(errCode == NRF_SUCCESS && gBulkPeer == peer)
+        {
+            ++gBulkTxSeq;
+            gBulkTxRemain      -= len - ATTR_BULK_SEQ_LEN;
+            gBulkStats.txBytes += len - ATTR_BULK_SEQ_LEN;
+            gBulkTxTicks        = app_timer_cnt_diff_compute(app_timer_cnt_get(), gBulkTxStart);
+        }
+        else if(errCode != NRF_SUCCESS)
+        {
+            bleServicePeerUnreserve(peer);
+            if(errCode != NRF_ERROR_RESOURCES)
+                gBulkTxRemain = 0;
+            // a completion that arrived since the queue was found full has made room
+            stop = !gBulkPumpAgain;
+            if(stop)
+                gBulkPumping = false;
+        }
+        CRITICAL_REGION_EXIT();
+
+        if(stop)
+            return;
+    }
+}
+
+bool bleServiceBulkSend(uint32_t bytes)
+{
+    bool found;
+
+    CRITICAL_REGION_ENTER();
+    gBulkPeer          = bleServiceBulkPeer();
+    found              = gBulkPeer != NULL;
+    gBulkStats.txBytes = 0;
+    gBulkTxSeq         = 0;
+    gBulkTxTicks       = 0;
+    gBulkTxStart       = app_timer_cnt_get();
+    gBulkTxRemain      = found ? bytes : 0;
+    CRITICAL_REGION_EXIT();
+
+    bleServiceBulkPump();
+    return found;
+}
+
+void bleServiceOnGATTUpdate(uint16_t hconn, uint16_t mtu, uint8_t dataLength)
+{
+    BLEPeer* peer = bleServicePeerFind(hconn);
+    if(peer == NULL)
+        return;
+
+    if(mtu != 0)
+        peer->mtu = mtu;
+    if(dataLength != 0)
+        peer->dataLength = dataLength;
+}
+
+static uint32_t bleServiceBulkRate(uint32_t bytes, uint32_t ticks)
+{
+    if(ticks == 0)
+        return 0;
+    return (uint64_t)bytes * APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1) / ticks / 1000;
+}
+
+// rates cover the span between the first and the last chunk of a run, in kB/s;
+// link parameters are those of the last bulk peer, or of the first connected one
+BLEBulkStats bleServiceGetBulkStats(void)
+{
+    BLEBulkStats stats = gBulkStats;
+    BLEPeer*     peer  = gBulkPeer;
+    for(uint8_t idx = 0; peer == NULL && idx < BLE_PEER_NUM; ++idx)
+        if(gPeers[idx].hconn != BLE_CONN_HANDLE_INVALID)
+            peer = &gPeers[idx];
+
+    stats.mtu        = peer ? peer->mtu : BLE_GATT_ATT_MTU_DEFAULT;
+    stats.dataLength = peer ? peer->dataLength : 27;
+    stats.phy        = peer ? peer->phy : BLE_GAP_PHY_1MBPS;
+    stats.rxKBps = bleServiceBulkRate(stats.rxBytes, gBulkRxTicks);
+    stats.txKBps = bleServiceBulkRate(stats.txBytes, gBulkTxTicks);
+    return stats;
 }
@@ -5,6 +5,7 @@
 #include "nordic_common.h"
 #include "nrf.h"
 #include "app_error.h"
+#include "app_util_platform.h"
 #include "ble.h"
 #include "ble_hci.h"
 #include "ble_srv_common.h"
@@ -29,21 +30,19 @@
 #include "nrf_log_backend_usb.h"
 
 #include "stack.h"
+#include "advphase.h"
 #include "service.h"
+#include "link.h"
+#include "observer.h"
 #include "queue.h"
 
 #define DEVICE_NAME                     "Aleksei Chernyshov"
 #define MANUFACTURER_NAME               "NordicSemiconductor"
-#define APP_ADV_INTERVAL                300
-
-#define APP_ADV_DURATION                18000
 #define APP_BLE_OBSERVER_PRIO           3
 #define APP_BLE_CONN_CFG_TAG            1
 
-#define MIN_CONN_INTERVAL               MSEC_TO_UNITS(100, UNIT_1_25_MS)
-#define MAX_CONN_INTERVAL               MSEC_TO_UNITS(200, UNIT_1_25_MS)
-#define SLAVE_LATENCY                   0
-#define CONN_SUP_TIMEOUT                MSEC_TO_UNITS(4000, UNIT_10_MS)
+// notifications the SoftDevice buffers per connection, keeps the bulk stream busy across connection events
+#define APP_HVN_TX_QUEUE_SIZE           8
 
 #define FIRST_CONN_PARAMS_UPDATE_DELAY  APP_TIMER_TICKS(5000)
 #define NEXT_CONN_PARAMS_UPDATE_DELAY   APP_TIMER_TICKS(30000)
@@ -51,7 +50,23 @@
 
 #define DEAD_BEEF                       0xDEADBEEF
 
-#define SCAN_RESP_DATA                  "Aleksei Chernyshov"
+// manufacturer data in the advertising packet: version, state sequence, input mode, h, s, v;
+// 0xFFFF is the identifier reserved for testing until a company identifier is assigned
+#define ADV_STATE_COMPANY_ID            0xFFFF
+#define ADV_STATE_VERSION               1
+#define ADV_STATE_LEN                   6
+
+// schedule tick, also folds elapsed time into the phase accounting before the timer counter wraps
+#define ADV_TICK_MS                     1000
+
+// estimated radio time of one advertising event: 3 channels x (~140 us ramp-up, 232 us for the
+// 13-byte payload at 1M, ~180 us listening for a scan request)
+#define ADV_EVENT_RADIO_US              1650
+
+// the SoftDevice adds 0-10 ms of random delay to each advertising interval
+#define ADV_EVENT_DELAY_US              5000
+
+#define ADV_TICK_FREQ                   (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
 
 #define SEC_PARAM_BOND                  0
 #define SEC_PARAM_MITM                  0
@@ -63,10 +78,15 @@
 #define SEC_PARAM_MAX_KEY_SIZE          16    
 
 NRF_BLE_GATT_DEF(m_gatt);
-NRF_BLE_QWR_DEF(m_qwr);
+NRF_BLE_QWRS_DEF(m_qwr, NRF_SDH_BLE_TOTAL_LINK_COUNT);
 BLE_ADVERTISING_DEF(m_advertising);
+APP_TIMER_DEF(gTimerAdv);
 
-static uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID;
+static const ble_gap_phys_t gPhys2M =
+{
+    .rx_phys = BLE_GAP_PHY_2MBPS,
+    .tx_phys = BLE_GAP_PHY_2MBPS
+};
 
 static ble_uuid_t m_adv_uuids[] =
 {
@@ -74,25 +94,63 @@ static ble_uuid_t m_adv_uuids[] =
     {UUID_BLE_SERVICE_SHRT, BLE_UUID_TYPE_BLE}
 };
 
-static ble_advdata_manuf_data_t gScanRespData =
+static uint8_t gAdvState[ADV_STATE_LEN] = {ADV_STATE_VERSION};
+
+static ble_advdata_manuf_data_t gAdvManufData =
 {
-    .company_identifier = 0,
+    .company_identifier = ADV_STATE_COMPANY_ID,
     .data               =
     {
-        .size   = sizeof(SCAN_RESP_DATA),
-        .p_data = (uint8_t*)SCAN_RESP_DATA
+        .size   = sizeof(gAdvState),
+        .p_data = gAdvState
     }
 };
 
+// the name moved to the scan response to leave room for the state in the advertising packet
+static ble_advdata_t gAdvData;
+static ble_advdata_t gSrData;
+
+// fast after boot, a disconnect or a switch press, then slow, then short fast bursts
+// separated by silence; sleep has no interval, its duration is the gap between bursts
+static BLEAdvPhaseConfig gAdvConfig[BLEAdvPhaseNum] =
+{
+    [BLEAdvPhaseFast]  = {.intervalMs = 100,  .durationS = 30},
+    [BLEAdvPhaseSlow]  = {.intervalMs = 1000, .durationS = 300},
+    [BLEAdvPhaseBurst] = {.intervalMs = 100,  .durationS = 3},
+    [BLEAdvPhaseSleep] = {.intervalMs = 0,    .durationS = 60},
+    [BLEAdvPhaseOff]   = {.intervalMs = 0,    .durationS = 0}
+};
+
+static const char* const gAdvPhaseNames[BLEAdvPhaseNum] =
+{
+    [BLEAdvPhaseFast]  = "fast",
+    [BLEAdvPhaseSlow]  = "slow",
+    [BLEAdvPhaseBurst] = "burst",
+    [BLEAdvPhaseSleep] = "sleep",
+    [BLEAdvPhaseOff]   = "off"
+};
+
+// phases change in the main loop only, the tick and the advertising module post EventAdvPhase;
+// the intervals are those the running advertising set was started with, later configuration
+// only applies from the next start
+static BLEAdvPhase gAdvPhase          = BLEAdvPhaseOff;
+static uint16_t    gAdvIntervalMs     = 0;
+static uint16_t    gAdvSlowIntervalMs = 0;
+static uint32_t    gAdvSleepLeft      = 0;
+static uint32_t    gAdvStamp          = 0;
+static uint64_t    gAdvPhaseTicks[BLEAdvPhaseNum];
+static uint64_t    gAdvPhaseEventTicks[BLEAdvPhaseNum];
+
 static void nrf_qwr_error_handler(uint32_t nrf_error)
 {
     APP_ERROR_HANDLER(nrf_error);
 }
 
+// the link policy keeps asking for other parameters as activity changes, a refusal is not fatal
 static void on_conn_params_evt(ble_conn_params_evt_t* p_evt)
 {
     if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
-        sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
+        NRF_LOG_INFO("Connection parameters refused by the central");
 }
 
 static void conn_params_error_handler(uint32_t nrf_error)
@@ -100,12 +158,65 @@ static void conn_params_error_handler(uint32_t nrf_error)
     APP_ERROR_HANDLER(nrf_error);
 }
 
+// folds the time since the last call into the running phase, together with the advertising
+// events its interval allows for in that time (scaled by ADV_TICK_FREQ)
+static void bleStackAdvAccount(void)
+{
+    uint32_t now   = app_timer_cnt_get();
+    uint32_t ticks = app_timer_cnt_diff_compute(now, gAdvStamp);
+
+    gAdvPhaseTicks[gAdvPhase] += ticks;
+    if(gAdvIntervalMs != 0)
+        gAdvPhaseEventTicks[gAdvPhase] += (uint64_t)ticks * 1000000 / (gAdvIntervalMs * 1000UL + ADV_EVENT_DELAY_US);
+    gAdvStamp = now;
+}
+
+static void bleStackAdvEnter(BLEAdvPhase phase, uint16_t intervalMs)
+{
+    CRITICAL_REGION_ENTER();
+    bleStackAdvAccount();
+    gAdvPhase      = phase;
+    gAdvIntervalMs = intervalMs;
+    if(phase == BLEAdvPhaseSleep)
+        gAdvSleepLeft = gAdvConfig[BLEAdvPhaseSleep].durationS;
+    CRITICAL_REGION_EXIT();
+    NRF_LOG_INFO("Advertising %s", gAdvPhaseNames[phase]);
+}
+
+// a fast start runs through slow on its own, a burst goes idle right after its fast part
+static void bleStackAdvStart(BLEAdvPhase phase)
+{
+    const BLEAdvPhaseConfig* fast = &gAdvConfig[phase];
+    const BLEAdvPhaseConfig* slow = &gAdvConfig[BLEAdvPhaseSlow];
+
+    ble_adv_modes_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.ble_adv_on_disconnect_disabled = true;
+    config.ble_adv_fast_enabled           = true;
+    config.ble_adv_fast_interval          = MSEC_TO_UNITS(fast->intervalMs, UNIT_0_625_MS);
+    config.ble_adv_fast_timeout           = fast->durationS * 100;
+    config.ble_adv_slow_enabled           = phase == BLEAdvPhaseFast;
+    config.ble_adv_slow_interval          = MSEC_TO_UNITS(slow->intervalMs, UNIT_0_625_MS);
+    config.ble_adv_slow_timeout           = slow->durationS * 100;
+
+    // reconfiguring a running advertising set is rejected, stopping an idle one is harmless
+    sd_ble_gap_adv_stop(m_advertising.adv_handle);
+    ble_advertising_modes_config_set(&m_advertising, &config);
+    gAdvSlowIntervalMs = slow->intervalMs;
+    bleStackAdvEnter(phase, fast->intervalMs);
+    ble_advertising_start(&m_advertising, BLE_ADV_MODE_FAST);
+}
+
 static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 {
     switch(ble_adv_evt)
     {
-        case BLE_ADV_EVT_FAST:
-            NRF_LOG_INFO("Fast advertising");
+        case BLE_ADV_EVT_SLOW:
+            queueEventEnqueue((Event){EventAdvPhase, {.num = BLEAdvPhaseSlow}});
+            break;
+
+        case BLE_ADV_EVT_IDLE:
+            queueEventEnqueue((Event){EventAdvPhase, {.num = BLEAdvPhaseSleep}});
             break;
 
         default:
@@ -113,48 +224,72 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
     }
 }
 
-static void onEventWrite(ble_evt_t const* p_ble_evt, void* p_context)
+static void bleStackAdvHandlerTick(void* p_context)
 {
-    NRF_LOG_INFO("Handle %u", (p_ble_evt->evt).gatts_evt.params.write.handle);
-    if((p_ble_evt->evt).gatts_evt.params.write.handle != bleServiceAttrHSVGetHandle())
-        return;
+    CRITICAL_REGION_ENTER();
+    bleStackAdvAccount();
+    CRITICAL_REGION_EXIT();
+
+    if(gAdvPhase == BLEAdvPhaseSleep && (gAdvSleepLeft == 0 || --gAdvSleepLeft == 0))
+        queueEventEnqueue((Event){EventAdvPhase, {.num = BLEAdvPhaseBurst}});
+}
 
-    Event event =
+static void onEventGATT(nrf_ble_gatt_t* p_gatt, nrf_ble_gatt_evt_t const* p_evt)
+{
+    switch(p_evt->evt_id)
     {
-        .type     = EventChangeColorHSV,
-        .data.hsv =
-        {
-            .h = (p_ble_evt->evt).gatts_evt.params.write.data[0],
-            .s = (p_ble_evt->evt).gatts_evt.params.write.data[1],
-            .v = (p_ble_evt->evt).gatts_evt.params.write.data[2]
-        }
-    };
-    queueEventEnqueue(event);
-    NRF_LOG_INFO("Queued color change by BLE");
+        case NRF_BLE_GATT_EVT_ATT_MTU_UPDATED:
+            NRF_LOG_INFO("ATT MTU %u", p_evt->params.att_mtu_effective);
+            bleServiceOnGATTUpdate(p_evt->conn_handle, p_evt->params.att_mtu_effective, 0);
+            break;
+
+        case NRF_BLE_GATT_EVT_DATA_LENGTH_UPDATED:
+            NRF_LOG_INFO("Data length %u", p_evt->params.data_length);
+            bleServiceOnGATTUpdate(p_evt->conn_handle, 0, p_evt->params.data_length);
+            break;
+
+        default:
+            break;
+    }
 }
 
 static void ble_evt_handler(ble_evt_t const* p_ble_evt, void* p_context)
 {
+    bleServiceOnEvent(p_ble_evt);
+    bleLinkOnEvent(p_ble_evt);
+    bleObserverOnEvent(p_ble_evt);
+
     switch(p_ble_evt->header.evt_id)
     {
         case BLE_GAP_EVT_DISCONNECTED:
-            NRF_LOG_INFO("Disconnected");
+            NRF_LOG_INFO("Disconnected %u", p_ble_evt->evt.gap_evt.conn_handle);
+            queueEventEnqueue((Event){EventAdvPhase, {.num = BLEAdvPhaseFast}});
             break;
 
         case BLE_GAP_EVT_CONNECTED:
-            NRF_LOG_INFO("Connected");
-            m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
-            nrf_ble_qwr_conn_handle_assign(&m_qwr, m_conn_handle);
+        {
+            uint16_t conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+            NRF_LOG_INFO("Connected %u", conn_handle);
+            nrf_ble_qwr_conn_handle_assign(&m_qwr[ble_conn_state_conn_idx(conn_handle)], conn_handle);
+            // the central may still fall back to 1M, the outcome arrives as BLE_GAP_EVT_PHY_UPDATE
+            sd_ble_gap_phy_update(conn_handle, &gPhys2M);
+
+            // advertising stops on connect, keep it going while links are left for other centrals
+            if(ble_conn_state_peripheral_conn_count() < NRF_SDH_BLE_PERIPHERAL_LINK_COUNT)
+                queueEventEnqueue((Event){EventAdvPhase, {.num = BLEAdvPhaseFast}});
+            else
+                queueEventEnqueue((Event){EventAdvPhase, {.num = BLEAdvPhaseOff}});
             break;
+        }
 
         case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
             NRF_LOG_DEBUG("PHY update request");
-            const ble_gap_phys_t phys =
-            {
-                .rx_phys = BLE_GAP_PHY_AUTO,
-                .tx_phys = BLE_GAP_PHY_AUTO,
-            };
-            sd_ble_gap_phy_update(p_ble_evt->evt.gap_evt.conn_handle, &phys);
+            sd_ble_gap_phy_update(p_ble_evt->evt.gap_evt.conn_handle, &gPhys2M);
+            break;
+
+        case BLE_GAP_EVT_PHY_UPDATE:
+            NRF_LOG_INFO("PHY tx %u rx %u", p_ble_evt->evt.gap_evt.params.phy_update.tx_phy,
+                                            p_ble_evt->evt.gap_evt.params.phy_update.rx_phy);
             break;
 
         case BLE_GATTC_EVT_TIMEOUT:
@@ -162,11 +297,6 @@ static void ble_evt_handler(ble_evt_t const* p_ble_evt, void* p_context)
             sd_ble_gap_disconnect(p_ble_evt->evt.gattc_evt.conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
             break;
 
-        case BLE_GATTS_EVT_WRITE:
-            NRF_LOG_DEBUG("GATT Server Write");
-            onEventWrite(p_ble_evt, p_context);
-            break;
-
         case BLE_GATTS_EVT_TIMEOUT:
             NRF_LOG_DEBUG("GATT Server Timeout");
             sd_ble_gap_disconnect(p_ble_evt->evt.gatts_evt.conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
@@ -186,7 +316,7 @@ static void pm_handler(const pm_evt_t* p_pm_evt)
     switch(p_pm_evt->evt_id)
     {
         case PM_EVT_PEERS_DELETE_SUCCEEDED:
-            ble_advertising_start(&m_advertising, BLE_ADV_MODE_FAST);
+            queueEventEnqueue((Event){EventAdvPhase, {.num = BLEAdvPhaseFast}});
             break;
 
         default:
@@ -199,27 +329,37 @@ void bleStackSetup(void)
     nrf_sdh_enable_request();
     uint32_t ram_start = 0;
     nrf_sdh_ble_default_cfg_set(APP_BLE_CONN_CFG_TAG, &ram_start);
+
+    ble_cfg_t ble_cfg;
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag                            = APP_BLE_CONN_CFG_TAG;
+    ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = APP_HVN_TX_QUEUE_SIZE;
+    sd_ble_cfg_set(BLE_CONN_CFG_GATTS, &ble_cfg, ram_start);
+
     nrf_sdh_ble_enable(&ram_start);
+
+    // let a connection event run past its nominal length while both sides have data
+    ble_opt_t ble_opt;
+    memset(&ble_opt, 0, sizeof(ble_opt));
+    ble_opt.common_opt.conn_evt_ext.enable = 1;
+    sd_ble_opt_set(BLE_COMMON_OPT_CONN_EVT_EXT, &ble_opt);
     NRF_SDH_BLE_OBSERVER(m_ble_observer, APP_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
 
-    ble_gap_conn_params_t   gap_conn_params;
     ble_gap_conn_sec_mode_t sec_mode;
     BLE_GAP_CONN_SEC_MODE_SET_OPEN(&sec_mode);
     sd_ble_gap_device_name_set(&sec_mode, (uint8_t const*)DEVICE_NAME, strlen(DEVICE_NAME));
     sd_ble_gap_appearance_set(BLE_APPEARANCE_UNKNOWN);
 
-    memset(&gap_conn_params, 0, sizeof(gap_conn_params));
-    gap_conn_params.min_conn_interval = MIN_CONN_INTERVAL;
-    gap_conn_params.max_conn_interval = MAX_CONN_INTERVAL;
-    gap_conn_params.slave_latency     = SLAVE_LATENCY;
-    gap_conn_params.conn_sup_timeout  = CONN_SUP_TIMEOUT;
-    sd_ble_gap_ppcp_set(&gap_conn_params);
+    bleLinkSetup();
 
-    nrf_ble_gatt_init(&m_gatt, NULL);
+    nrf_ble_gatt_init(&m_gatt, onEventGATT);
+    nrf_ble_gatt_att_mtu_periph_set(&m_gatt, NRF_SDH_BLE_GATT_MAX_MTU_SIZE);
+    nrf_ble_gatt_data_length_set(&m_gatt, BLE_CONN_HANDLE_INVALID, NRF_SDH_BLE_GAP_DATA_LENGTH);
 
     nrf_ble_qwr_init_t qwr_init = {0};
     qwr_init.error_handler = nrf_qwr_error_handler;
-    nrf_ble_qwr_init(&m_qwr, &qwr_init);
+    for(uint8_t idx = 0; idx < NRF_SDH_BLE_TOTAL_LINK_COUNT; ++idx)
+        nrf_ble_qwr_init(&m_qwr[idx], &qwr_init);
 
     pm_init();
     ble_gap_sec_params_t sec_param;
@@ -242,16 +382,22 @@ void bleStackSetup(void)
 
     ble_advertising_init_t init;
     memset(&init, 0, sizeof(init));
-    init.advdata.flags                   = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
-    init.advdata.name_type               = BLE_ADVDATA_FULL_NAME;
-    init.advdata.include_appearance      = false;
-    init.advdata.include_ble_device_addr = false;
+    memset(&gAdvData, 0, sizeof(gAdvData));
+    gAdvData.flags                       = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
+    gAdvData.name_type                   = BLE_ADVDATA_NO_NAME;
+    gAdvData.include_appearance          = false;
+    gAdvData.include_ble_device_addr     = false;
+    gAdvData.p_manuf_specific_data       = &gAdvManufData;
+    memset(&gSrData, 0, sizeof(gSrData));
+    gSrData.name_type                    = BLE_ADVDATA_FULL_NAME;
+    gSrData.uuids_complete.uuid_cnt      = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
+    gSrData.uuids_complete.p_uuids       = m_adv_uuids;
+
+    init.advdata                         = gAdvData;
+    init.srdata                          = gSrData;
     init.config.ble_adv_fast_enabled     = true;
-    init.config.ble_adv_fast_interval    = APP_ADV_INTERVAL;
-    init.config.ble_adv_fast_timeout     = APP_ADV_DURATION;
-    init.srdata.uuids_complete.uuid_cnt  = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
-    init.srdata.uuids_complete.p_uuids   = m_adv_uuids;
-    init.srdata.p_manuf_specific_data    = &gScanRespData;
+    init.config.ble_adv_fast_interval    = MSEC_TO_UNITS(gAdvConfig[BLEAdvPhaseFast].intervalMs, UNIT_0_625_MS);
+    init.config.ble_adv_fast_timeout     = gAdvConfig[BLEAdvPhaseFast].durationS * 100;
     init.evt_handler = on_adv_evt;
     ble_advertising_init(&m_advertising, &init);
     ble_advertising_conn_cfg_tag_set(&m_advertising, APP_BLE_CONN_CFG_TAG);
@@ -268,5 +414,109 @@ void bleStackSetup(void)
     cp_init.error_handler                  = conn_params_error_handler;
     ble_conn_params_init(&cp_init);
 
-    ble_advertising_start(&m_advertising, BLE_ADV_MODE_FAST);
+    gAdvStamp = app_timer_cnt_get();
+    app_timer_create(&gTimerAdv, APP_TIMER_MODE_REPEATED, bleStackAdvHandlerTick);
+    app_timer_start(gTimerAdv, APP_TIMER_TICKS(ADV_TICK_MS), NULL);
+    bleStackAdvStart(BLEAdvPhaseFast);
+}
+
+// a switch press makes the device discoverable again without waiting for the next burst
+void bleStackAdvRestart(void)
+{
+    if(gAdvPhase != BLEAdvPhaseOff)
+        bleStackAdvStart(BLEAdvPhaseFast);
+}
+
+static AdvModuleMode bleStackAdvModuleMode(void)
+{
+    switch(m_advertising.adv_mode_current)
+    {
+    case BLE_ADV_MODE_IDLE:
+        return AdvModuleIdle;
+
+    case BLE_ADV_MODE_FAST:
+        return AdvModuleFast;
+
+    case BLE_ADV_MODE_SLOW:
+        return AdvModuleSlow;
+
+    default:
+        return AdvModuleOther;
+    }
+}
+
+void bleStackAdvProcess(BLEAdvPhase phase)
+{
+    switch(advPhaseNext(gAdvPhase, phase, bleStackAdvModuleMode()))
+    {
+    case AdvPhaseActionStart:
+        bleStackAdvStart(phase);
+        break;
+
+    case AdvPhaseActionEnter:
+        bleStackAdvEnter(phase, phase == BLEAdvPhaseSlow ? gAdvSlowIntervalMs : 0);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void bleStackAdvConfigure(BLEAdvPhase phase, BLEAdvPhaseConfig config)
+{
+    if(phase < BLEAdvPhaseOff)
+        gAdvConfig[phase] = config;
+}
+
+// radio time is estimated from the advertising events accumulated with the interval each span ran at
+BLEAdvStats bleStackAdvGetStats(void)
+{
+    BLEAdvStats stats = {.phase = gAdvPhase};
+
+    CRITICAL_REGION_ENTER();
+    bleStackAdvAccount();
+    for(uint8_t phase = 0; phase < BLEAdvPhaseNum; ++phase)
+    {
+        BLEAdvPhaseStats* entry = &stats.phases[phase];
+        entry->ms      = gAdvPhaseTicks[phase] * 1000 / ADV_TICK_FREQ;
+        entry->events  = gAdvPhaseEventTicks[phase] / ADV_TICK_FREQ;
+        entry->radioMs = (uint64_t)entry->events * ADV_EVENT_RADIO_US / 1000;
+    }
+    CRITICAL_REGION_EXIT();
+    return stats;
+}
+
+const char* bleStackAdvPhaseToName(BLEAdvPhase phase)
+{
+    if(phase >= BLEAdvPhaseNum)
+        return "";
+    return gAdvPhaseNames[phase];
+}
+
+BLEAdvPhase bleStackAdvPhaseFromName(const char* name)
+{
+    for(uint8_t phase = 0; phase < BLEAdvPhaseNum; ++phase)
+        if(strcmp(name, gAdvPhaseNames[phase]) == 0)
+            return phase;
+    return BLEAdvPhaseNum;
+}
+
+// the payload is re-encoded only when the state differs, the sequence lets observers spot missed updates;
+// main loop only: gAdvState has no other writer, and the payload is re-encoded by an SVC call
+// that must not run with interrupts masked
+void bleStackAdvUpdate(ColorHSV color, uint8_t mode)
+{
+    if(gAdvState[2] == mode && gAdvState[3] == color.h && gAdvState[4] == color.s && gAdvState[5] == color.v)
+        return;
+
+    ++gAdvState[1];
+    gAdvState[2] = mode;
+    gAdvState[3] = color.h;
+    gAdvState[4] = color.s;
+    gAdvState[5] = color.v;
+    ble_advertising_advdata_update(&m_advertising, &gAdvData, &gSrData);
+
+    // observers between bursts would otherwise miss the change for a whole sleep period
+    if(gAdvPhase == BLEAdvPhaseSleep)
+        bleStackAdvStart(BLEAdvPhaseBurst);
 }
@@ -1,27 +1,159 @@
+#include <inttypes.h>
+#include <stdio.h>
 #include <string.h>
-#include <stdlib.h>
 
 #include "app_usbd_cdc_acm.h"
+#include "nrf_drv_usbd.h"
+#include "app_util_platform.h"
+#include "crc16.h"
 
 #include "queue.h"
 #include "leds.h"
+#include "strip.h"
+#include "anim.h"
+#include "power.h"
 #include "utils.h"
 #include "flash.h"
 #include "metadata.h"
+#include "macro.h"
+#include "bench.h"
+#include "service.h"
+#include "link.h"
+#include "stack.h"
+#include "observer.h"
+#include "prof.h"
 
 #include "cmd.h"
 #include "cli.h"
+#include "frame.h"
+#include "parse.h"
 
-#define BUFFER_SIZE_ECHO 1
-#define BUFFER_SIZE_MAIN 256
+// one full-speed bulk packet per transfer
+#define BUFFER_SIZE_RX   64
+#define BUFFER_SIZE_LINE 256
+// both must be powers of two
+#define BUFFER_SIZE_TX   4096
+#define CLI_LINE_NUM     8
+#define BUFFER_SIZE_RESP 192
+#define BUFFER_SIZE_ECHO 320
 
-#define COMMAND_WORD_NUM_MAX 8
-#define COMMAND_WORD_LEN_MAX 32
+// history keeps the last lines that fit into an entry, the count must be a power of two
+#define CLI_HISTORY_NUM 4
+#define CLI_HISTORY_LEN 128
 
+// one transfer per max-size packet, the ring is drained from TX_DONE
+#define CLI_TX_CHUNK_SIZE NRF_DRV_USBD_EPSIZE
+
+// free TX space required before a line or a stream step is executed, must cover the largest single response
+#define CLI_TX_RESERVE (BUFFER_SIZE_TX / 2)
+
+// help text bytes written per stream step
+#define CLI_HELP_CHUNK 512
+
+// static RAM of the USB command path: the buffers of this file and the frame protocol buffers
+// of frame.c, 7232 B + 1260 B = 8492 B with the sizes above; the flash_load page image borrows
+// the strip memory and takes none of its own
+#define CLI_RAM_BYTES (BUFFER_SIZE_RX + BUFFER_SIZE_TX + BUFFER_SIZE_RESP + BUFFER_SIZE_ECHO + \
+                       CLI_LINE_NUM * BUFFER_SIZE_LINE + CLI_HISTORY_NUM * CLI_HISTORY_LEN + \
+                       FRAME_RAM_BYTES)
+
+// macro_add takes its name and the steps as tokens of one line, a step is at least two tokens
+#define CLI_MACRO_TOKEN_MAX (PARSE_TOKEN_NUM_MAX - 2)
+#define CLI_MACRO_STEP_MAX  (CLI_MACRO_TOKEN_MAX / 2)
+
+// record bytes per flash_dump line, keeps the line within BUFFER_SIZE_RESP and the history limit
+#define CLI_DUMP_CHUNK 64
+
+#ifndef CLI_RAM_BUDGET
+#define CLI_RAM_BUDGET 9216
+#endif
+
+typedef enum
+{
+    CliEscNone,
+    CliEscStart,
+    CliEscCSI,
+    CliEscSS3
+} CliEscState;
+
+typedef struct
+{
+    uint32_t events;
+    uint32_t cycles;
+    uint32_t cyclesMax;
+    uint32_t lines;
+    uint32_t linesDropped;
+    uint32_t linesDeferred;
+    uint32_t txBytes;
+    uint32_t txDropped;
+} CliStats;
+
+typedef void (*CliHandler)(const ParseArgs* args);
+
+// called from the main loop while TX space allows, returns false once the output is complete
+typedef bool (*CliStream)(void);
+
+typedef struct
+{
+    uint8_t  page;
+    uint8_t  pageLast;
+    bool     begun;
+    uint32_t addr;
+    uint16_t recordLen;
+    uint16_t recordPos;
+    uint16_t offset;
+    uint16_t crc;
+} CliDump;
+
+typedef struct
+{
+    const char* name;
+    uint8_t     nameLen;
+    uint8_t     argcMin;
+    uint8_t     argcMax;
+    CliHandler  handler;
+} CliCommand;
+
+static char gBufferRx[BUFFER_SIZE_RX];
+static char gBufferTx[BUFFER_SIZE_TX];
+static char gBufferResp[BUFFER_SIZE_RESP];
 static char gBufferEcho[BUFFER_SIZE_ECHO];
-static char gBufferMain[BUFFER_SIZE_MAIN];
+static uint16_t gEchoLen = 0;
+
+// lines are assembled by the USB handler and executed from the main loop via EventCliLine,
+// a slot is released only after its command has run
+static char             gLines[CLI_LINE_NUM][BUFFER_SIZE_LINE];
+static uint16_t         gLineLen    = 0;
+static uint16_t         gLineCursor = 0;
+static volatile uint8_t gLineHead = 0;
+static volatile uint8_t gLineTail = 0;
+static bool             gRxLastCR = false;
+static CliEscState      gEscState = CliEscNone;
+static bool             gLineOverflow = false;
+
+static char    gHistory[CLI_HISTORY_NUM][CLI_HISTORY_LEN];
+static uint8_t gHistoryHead = 0;
+static uint8_t gHistoryNum  = 0;
+static uint8_t gHistoryPos  = 0;
+
+static volatile CliMode gCliMode = CliModeText;
 
-static char gCommand[COMMAND_WORD_NUM_MAX][COMMAND_WORD_LEN_MAX];
+static volatile uint16_t gTxHead        = 0;
+static volatile uint16_t gTxTail        = 0;
+static volatile uint16_t gTxInFlight    = 0;
+static volatile bool     gLineDeferred  = false;
+static volatile bool     gCliPortClosed = false;
+
+static CliStats gCliStats;
+
+static CliStream gCliStream = NULL;
+static CliDump   gCliDump;
+static uint16_t  gCliHelpPos = 0;
+
+STATIC_ASSERT(CLI_HELP_CHUNK <= CLI_TX_RESERVE, "help chunk does not fit the TX reserve");
+STATIC_ASSERT(CLI_MACRO_STEP_MAX <= MACRO_STEP_NUM_MAX, "macro_add accepts more steps than the player holds");
+STATIC_ASSERT(STRIP_SCRATCH_BYTES >= CODE_PAGE_SIZE, "flash_load images do not fit the strip memory");
+STATIC_ASSERT(CLI_RAM_BYTES <= CLI_RAM_BUDGET, "CLI buffers exceed their RAM budget");
 
 static void usbdHandler(const app_usbd_class_inst_t* p_inst,
                         app_usbd_cdc_acm_user_event_t event);
@@ -31,164 +163,1142 @@ APP_USBD_CDC_ACM_GLOBAL_DEF(usbdInstance, usbdHandler,
                             CDC_ACM_COMM_EPIN, CDC_ACM_DATA_EPIN, CDC_ACM_DATA_EPOUT,
                             APP_USBD_CDC_COMM_PROTOCOL_NONE);
 
-static void cliBufferReset(void)
+void cliSetup(void)
 {
-    gBufferEcho[0] = '\0';
-    gBufferMain[0] = '\0';
-    for(uint8_t idx = 0; idx < COMMAND_WORD_NUM_MAX; ++idx)
-        gCommand[idx][0] = '\0';
+    app_usbd_class_append(app_usbd_cdc_acm_class_inst_get(&usbdInstance));
 }
 
-void cliSetup(void)
+static void cliTxKick(void)
 {
-    cliBufferReset();
-    app_usbd_class_append(app_usbd_cdc_acm_class_inst_get(&usbdInstance));
+    if(gTxInFlight != 0 || gTxHead == gTxTail)
+        return;
+
+    uint16_t len = gTxHead > gTxTail ? gTxHead - gTxTail : BUFFER_SIZE_TX - gTxTail;
+    if(len > CLI_TX_CHUNK_SIZE)
+        len = CLI_TX_CHUNK_SIZE;
+    if(app_usbd_cdc_acm_write(&usbdInstance, &gBufferTx[gTxTail], len) == NRF_SUCCESS)
+        gTxInFlight = len;
+}
+
+static uint16_t cliTxSpace(void)
+{
+    return (gTxTail - gTxHead - 1) & (BUFFER_SIZE_TX - 1);
+}
+
+// output is copied into the TX ring and sent from there, so callers may reuse their buffers;
+// a write that does not fit is dropped as a whole and reported back
+bool cliWrite(const char* data, size_t len)
+{
+    bool written = false;
+
+    CRITICAL_REGION_ENTER();
+    if(len <= cliTxSpace())
+    {
+        uint16_t head  = gTxHead;
+        uint16_t room  = BUFFER_SIZE_TX - head;
+        uint16_t first = room < len ? room : len;
+        memcpy(&gBufferTx[head], data, first);
+        memcpy(gBufferTx, data + first, len - first);
+        gTxHead = (head + len) & (BUFFER_SIZE_TX - 1);
+        gCliStats.txBytes += len;
+        written = true;
+        cliTxKick();
+    }
+    else
+        ++gCliStats.txDropped;
+    CRITICAL_REGION_EXIT();
+
+    return written;
+}
+
+static bool cliWriteStr(const char* str)
+{
+    return cliWrite(str, strlen(str));
+}
+
+// reports a malformed or out of range number to the operator
+static bool cliArgNum(const ParseArgs* args, uint8_t idx, uint32_t max, uint32_t* value)
+{
+    if(parseNumber(parseArg(args, idx), max, value))
+        return true;
+
+    cliWriteStr(gCmdResponseBadValue);
+    return false;
+}
+
+static bool cliArgColor(const ParseArgs* args, uint8_t idx, uint8_t* color)
+{
+    for(uint8_t cnt = 0; cnt < 3; ++cnt)
+    {
+        uint32_t value;
+        if(!cliArgNum(args, idx + cnt, UINT8_MAX, &value))
+            return false;
+        color[cnt] = value;
+    }
+    return true;
+}
+
+// the help text outgrew the TX reserve, it is written in slices as space frees up
+static bool cliStreamHelp(void)
+{
+    uint16_t len = sizeof(gCmdResponseHelp) - 1 - gCliHelpPos;
+    if(len > CLI_HELP_CHUNK)
+        len = CLI_HELP_CHUNK;
+
+    cliWrite(&gCmdResponseHelp[gCliHelpPos], len);
+    gCliHelpPos += len;
+    return gCliHelpPos < sizeof(gCmdResponseHelp) - 1;
+}
+
+static void cliCmdHelp(const ParseArgs* args)
+{
+    gCliHelpPos = 0;
+    gCliStream  = cliStreamHelp;
+}
+
+static void cliCmdRgb(const ParseArgs* args)
+{
+    uint8_t color[3];
+    if(!cliArgColor(args, 1, color))
+        return;
+
+    ColorRGB rgb =
+    {
+        .r = color[0],
+        .g = color[1],
+        .b = color[2]
+    };
+    queueEventEnqueue((Event){EventChangeColorRGB, {.rgb = rgb}});
+}
+
+static void cliCmdHsv(const ParseArgs* args)
+{
+    uint8_t color[3];
+    if(!cliArgColor(args, 1, color))
+        return;
+
+    ColorHSV hsv =
+    {
+        .h = color[0],
+        .s = color[1],
+        .v = color[2]
+    };
+    queueEventEnqueue((Event){EventChangeColorHSV, {.hsv = hsv}});
+}
+
+static void cliCmdColorAddRgb(const ParseArgs* args)
+{
+    uint8_t color[3];
+    if(!cliArgColor(args, 1, color))
+        return;
+
+    Metadata meta =
+    {
+        .type   = METADATA_TYPE_COLOR_RGB_NAMED,
+        .state  = METADATA_STATE_ACTIVE,
+        .length = 0
+    };
+    if(flashRecordCountMeta(1, meta) > 10)
+    {
+        cliWriteStr(gCmdResponseNoSpace);
+        return;
+    }
+    ColorRGB rgb =
+    {
+        .r = color[0],
+        .g = color[1],
+        .b = color[2]
+    };
+    flashSaveColorRGBNamed(rgb, parseArg(args, 4));
+}
+
+static void cliCmdColorAddCur(const ParseArgs* args)
+{
+    ColorRGB rgb = ledsGetLED2State();
+    flashSaveColorRGBNamed(rgb, parseArg(args, 1));
+}
+
+static void cliCmdColorSet(const ParseArgs* args)
+{
+    ColorRGB rgb;
+    FlashRetCode retCode = flashLoadColorRGBNamed(&rgb, parseArg(args, 1));
+    if(retCode == FlashRetCodeSuccess)
+        queueEventEnqueue((Event){EventChangeColorRGB, {.rgb = rgb}});
+    if(retCode == FlashRetCodeMetaNotFound)
+        cliWriteStr(gCmdResponseNoColor);
+}
+
+static void cliCmdColorDel(const ParseArgs* args)
+{
+    FlashRetCode retCode = flashDeleteColorRGBNamed(parseArg(args, 1));
+    if(retCode == FlashRetCodeMetaNotFound)
+        cliWriteStr(gCmdResponseNoColor);
+}
+
+static void cliCmdAnim(const ParseArgs* args)
+{
+    AnimEffect effect = animEffectFromName(parseArg(args, 1));
+    if(effect == AnimEffectNum)
+    {
+        cliWriteStr(gCmdResponseNoEffect);
+        return;
+    }
+    uint32_t period = 0;
+    if(args->num > 2 && !cliArgNum(args, 2, UINT16_MAX, &period))
+        return;
+    AnimParams params =
+    {
+        .effect   = effect,
+        .periodMs = period
+    };
+    queueEventEnqueue((Event){EventAnimStart, {.anim = params}});
+}
+
+static void cliCmdAnimBudget(const ParseArgs* args)
+{
+    uint32_t budget;
+    if(cliArgNum(args, 1, UINT32_MAX, &budget))
+        animSetBudget(budget);
+}
+
+static void cliCmdAnimStats(const ParseArgs* args)
+{
+    AnimStats stats = animGetStats();
+    int len = snprintf(gBufferResp, BUFFER_SIZE_RESP,
+                       "frames %" PRIu32 ", over budget %" PRIu32 ", last %" PRIu32 " us, max %" PRIu32 " us, budget %" PRIu32 " us\r\n"
+                       "stream colors %" PRIu32 ", dropped %" PRIu32 ", resyncs %" PRIu32 "\r\n",
+                       stats.frames, stats.overruns, stats.lastUs, stats.maxUs, stats.budgetUs,
+                       stats.streamColors, stats.streamDropped, stats.streamResyncs);
+    cliWrite(gBufferResp, len);
 }
 
-static void cliBufferAppend(void)
+static void cliCmdPower(const ParseArgs* args)
 {
-    if(strlen(gBufferMain) + 1 < BUFFER_SIZE_MAIN)
-        strcat(gBufferMain, gBufferEcho);
+    PowerStats stats = powerGetStats();
+    int len = snprintf(gBufferResp, BUFFER_SIZE_RESP,
+                       "estimate %" PRIu32 " mA (fixed %" PRIu32 " mA), drawn %" PRIu32 " mA, budget %" PRIu32 " mA, scale %u/256, limited %" PRIu32 " of %" PRIu32 " commits\r\n",
+                       stats.estimateUA / 1000, stats.fixedUA / 1000, stats.drawnUA / 1000, stats.budgetMA, stats.scale,
+                       stats.commitsLimited, stats.commits);
+    cliWrite(gBufferResp, len);
 }
 
-static void cliBufferParse(void)
+static void cliCmdPowerBudget(const ParseArgs* args)
 {
-    char*   token = strtok(gBufferMain, " ");
-    uint8_t tokenIdx = 0;
-    while(token != NULL && tokenIdx < COMMAND_WORD_NUM_MAX)
+    uint32_t budget;
+    if(cliArgNum(args, 1, UINT16_MAX, &budget))
+        powerSetBudget(budget);
+}
+
+static bool cliMacroParseStep(const ParseArgs* args, uint8_t* idx, MacroStep* step)
+{
+    const char* op = parseArg(args, *idx);
+    uint8_t     argc;
+
+    if(strcmp(op, "rgb") == 0)
+    {
+        step->op = MacroOpRGB;
+        argc     = 3;
+    }
+    else if(strcmp(op, "hsv") == 0)
+    {
+        step->op = MacroOpHSV;
+        argc     = 3;
+    }
+    else if(strcmp(op, "delay") == 0)
+    {
+        step->op = MacroOpDelay;
+        argc     = 1;
+    }
+    else
+        return false;
+
+    if(*idx + argc >= args->num)
+        return false;
+
+    if(step->op == MacroOpDelay)
     {
-        strcpy(gCommand[tokenIdx++], token);
-        token = strtok(NULL, " ");
+        uint32_t ms;
+        if(!parseNumber(parseArg(args, *idx + 1), UINT16_MAX, &ms))
+            return false;
+        step->args[0] = ms & 0xFF;
+        step->args[1] = ms >> 8;
+        step->args[2] = 0;
+    }
+    else
+    {
+        for(uint8_t arg = 0; arg < 3; ++arg)
+        {
+            uint32_t value;
+            if(!parseNumber(parseArg(args, *idx + 1 + arg), UINT8_MAX, &value))
+                return false;
+            step->args[arg] = value;
+        }
     }
+
+    *idx += 1 + argc;
+    return true;
+}
+
+static void cliMacroRejected(void)
+{
+    int len = snprintf(gBufferResp, BUFFER_SIZE_RESP, gCmdResponseBadMacro, MACRO_NAME_LEN_MAX, CLI_MACRO_TOKEN_MAX);
+    cliWrite(gBufferResp, len);
 }
 
-static void cliExecCommand(void)
+static void cliCmdMacroAdd(const ParseArgs* args)
 {
-    if(strcmp(gCommand[0], gCmdHelp) == 0)
+    MacroStep steps[CLI_MACRO_STEP_MAX];
+    uint8_t   stepNum = 0;
+    uint8_t   idx     = 2;
+
+    if(args->tokens[1].length > MACRO_NAME_LEN_MAX)
     {
-        app_usbd_cdc_acm_write(&usbdInstance, gCmdResponseHelp, sizeof(gCmdResponseHelp));
+        cliMacroRejected();
         return;
     }
 
-    if(strcmp(gCommand[0], gCmdRgb) == 0)
+    while(idx < args->num)
     {
-        ColorRGB rgb =
+        if(stepNum == CLI_MACRO_STEP_MAX || !cliMacroParseStep(args, &idx, &steps[stepNum++]))
         {
-            .r = strtoul(gCommand[1], NULL, 10),
-            .g = strtoul(gCommand[2], NULL, 10),
-            .b = strtoul(gCommand[3], NULL, 10)
-        };
-        queueEventEnqueue((Event){EventChangeColorRGB, {.rgb = rgb}});
+            cliMacroRejected();
+            return;
+        }
+    }
+
+    if(flashSaveMacro(parseArg(args, 1), (const uint8_t*)steps, stepNum * sizeof(MacroStep)) != FlashRetCodeSuccess)
+        cliWriteStr(gCmdResponseNoSpace);
+}
+
+static void cliCmdMacro(const ParseArgs* args)
+{
+    uint32_t repeats = 1;
+    if(args->num > 2 && !cliArgNum(args, 2, UINT8_MAX, &repeats))
         return;
+    if(macroStart(parseArg(args, 1), repeats) == FlashRetCodeMetaNotFound)
+        cliWriteStr(gCmdResponseNoMacro);
+}
+
+static void cliCmdMacroStop(const ParseArgs* args)
+{
+    macroStop();
+}
+
+static void cliCmdMacroDel(const ParseArgs* args)
+{
+    if(flashDeleteMacro(parseArg(args, 1)) == FlashRetCodeMetaNotFound)
+        cliWriteStr(gCmdResponseNoMacro);
+}
+
+static uint16_t cliHexEncode(char* dst, const uint8_t* data, uint16_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    for(uint16_t idx = 0; idx < len; ++idx)
+    {
+        *dst++ = digits[data[idx] >> 4];
+        *dst++ = digits[data[idx] & 0x0F];
     }
+    return 2 * len;
+}
+
+// live records of a page are packed back to back and printed as flash_load lines,
+// so the dump can be replayed as is to provision another unit
+static bool cliStreamDump(void)
+{
+    CliDump* dump = &gCliDump;
+    int      len;
 
-    if(strcmp(gCommand[0], gCmdHsv) == 0)
+    if(!dump->begun)
     {
-        ColorHSV hsv =
+        dump->begun     = true;
+        dump->addr      = 0;
+        dump->recordLen = 0;
+        dump->recordPos = 0;
+        dump->offset    = 0;
+        dump->crc       = 0xFFFF;
+        len = snprintf(gBufferResp, BUFFER_SIZE_RESP, "flash_load %u begin\r\n", dump->page);
+        cliWrite(gBufferResp, len);
+        return true;
+    }
+
+    uint8_t  chunk[CLI_DUMP_CHUNK];
+    uint16_t chunkLen = 0;
+    while(chunkLen < CLI_DUMP_CHUNK)
+    {
+        if(dump->recordPos == dump->recordLen)
         {
-            .h = strtoul(gCommand[1], NULL, 10),
-            .s = strtoul(gCommand[2], NULL, 10),
-            .v = strtoul(gCommand[3], NULL, 10)
-        };
-        queueEventEnqueue((Event){EventChangeColorHSV, {.hsv = hsv}});
+            if(flashRecordNext(dump->page, &dump->addr, &dump->recordLen) != FlashRetCodeSuccess)
+                break;
+            dump->recordPos = 0;
+        }
+
+        uint16_t num = dump->recordLen - dump->recordPos;
+        if(num > CLI_DUMP_CHUNK - chunkLen)
+            num = CLI_DUMP_CHUNK - chunkLen;
+        memcpy(&chunk[chunkLen], (const uint8_t*)(uintptr_t)(dump->addr + dump->recordPos), num);
+        dump->recordPos += num;
+        chunkLen        += num;
+    }
+
+    if(chunkLen > 0)
+    {
+        len  = snprintf(gBufferResp, BUFFER_SIZE_RESP, "flash_load %u %u ", dump->page, dump->offset);
+        len += cliHexEncode(&gBufferResp[len], chunk, chunkLen);
+        gBufferResp[len++] = '\r';
+        gBufferResp[len++] = '\n';
+        cliWrite(gBufferResp, len);
+
+        dump->crc     = crc16_compute(chunk, chunkLen, &dump->crc);
+        dump->offset += chunkLen;
+        return true;
+    }
+
+    len = snprintf(gBufferResp, BUFFER_SIZE_RESP, "flash_load %u commit %u %u\r\n", dump->page, dump->offset, dump->crc);
+    cliWrite(gBufferResp, len);
+
+    dump->begun = false;
+    return dump->page++ < dump->pageLast;
+}
+
+// pages 1 (named colors) and 2 (macros) by default, page 0 only holds the last color
+static void cliCmdFlashDump(const ParseArgs* args)
+{
+    gCliDump.page     = 1;
+    gCliDump.pageLast = 2;
+    if(args->num > 1)
+    {
+        uint32_t page;
+        if(!cliArgNum(args, 1, 2, &page))
+            return;
+        gCliDump.page     = page;
+        gCliDump.pageLast = page;
+    }
+
+    gCliDump.begun = false;
+    gCliStream     = cliStreamDump;
+}
+
+// releases the staged image and brings the strip back, a no-op when no upload is running
+static void cliFlashLoadAbort(void)
+{
+    flashImageAbort();
+    stripResume();
+}
+
+static void cliCmdFlashLoad(const ParseArgs* args)
+{
+    const char*  op       = parseArg(args, 2);
+    FlashRetCode retCode  = FlashRetCodeBadImage;
+    bool         reported = false;
+    uint32_t     page;
+    uint32_t     value;
+    uint32_t     crc;
+
+    // the image is staged in the strip memory, the strip is paused until the commit
+    if(!cliArgNum(args, 1, 2, &page))
+        reported = true;
+    else if(strcmp(op, "begin") == 0)
+    {
+        animStop();
+        retCode = flashImageBegin(page, stripSuspend());
+    }
+    else if(strcmp(op, "abort") == 0 && args->num == 3)
+    {
+        cliFlashLoadAbort();
+        cliWriteStr(gCmdResponseImageAborted);
+        return;
+    }
+    else if(strcmp(op, "commit") == 0 && args->num == 5)
+    {
+        reported = !cliArgNum(args, 3, CODE_PAGE_SIZE, &value) || !cliArgNum(args, 4, UINT16_MAX, &crc);
+        if(!reported)
+        {
+            retCode = flashImageCommit(page, value, crc);
+            if(retCode == FlashRetCodeSuccess)
+                cliWriteStr(gCmdResponsePageWritten);
+            else if(retCode == FlashRetCodeBadWrite)
+            {
+                cliWriteStr(gCmdResponsePageBad);
+                reported = true;
+            }
+        }
+    }
+    else if(args->num == 4 && args->tokens[3].length <= 2 * CLI_DUMP_CHUNK)
+    {
+        uint8_t data[CLI_DUMP_CHUNK];
+        reported = !cliArgNum(args, 2, CODE_PAGE_SIZE, &value);
+        if(!reported && parseHex(data, parseArg(args, 3), args->tokens[3].length))
+            retCode = flashImageWrite(page, value, data, args->tokens[3].length / 2);
+    }
+
+    // a commit ends the upload whatever its outcome, any rejected line abandons it;
+    // either way the strip comes back, the host starts over with begin
+    if(retCode == FlashRetCodeSuccess && strcmp(op, "commit") != 0)
+        return;
+
+    cliFlashLoadAbort();
+    if(retCode != FlashRetCodeSuccess && !reported)
+        cliWriteStr(gCmdResponseImageRejected);
+}
+
+static void cliBenchReport(uint8_t idx, uint8_t repeats)
+{
+    BenchResult result;
+    benchRun(idx, repeats, &result);
+
+    int len = snprintf(gBufferResp, BUFFER_SIZE_RESP,
+                       "%-16s min %" PRIu32 ", median %" PRIu32 ", max %" PRIu32 " cycles (median %" PRIu32 " us)\r\n",
+                       benchGetName(idx), result.min, result.median, result.max,
+                       profCyclesToUs(result.median));
+    cliWrite(gBufferResp, len);
+}
+
+// cases run back to back in the main loop, the output of all of them fits the TX reserve
+static void cliCmdBench(const ParseArgs* args)
+{
+    uint32_t repeats = 16;
+    if(args->num > 2 && !cliArgNum(args, 2, BENCH_REPEATS_MAX, &repeats))
+        return;
+
+    if(args->num > 1 && strcmp(parseArg(args, 1), "all") != 0)
+    {
+        uint8_t idx = benchFind(parseArg(args, 1));
+        if(idx == benchGetNum())
+            cliWriteStr(gCmdResponseNoBench);
+        else
+            cliBenchReport(idx, repeats);
+        return;
+    }
+
+    for(uint8_t idx = 0; idx < benchGetNum(); ++idx)
+        cliBenchReport(idx, repeats);
+}
+
+static void cliCmdBleStats(const ParseArgs* args)
+{
+    BLENotifyStats stats = bleServiceGetNotifyStats();
+    int len = snprintf(gBufferResp, BUFFER_SIZE_RESP,
+                       "hsv notifications: %" PRIu32 " sent, %" PRIu32 " coalesced, %" PRIu32 " failed, %" PRIu32 " skipped without subscriber\r\n",
+                       stats.sent, stats.coalesced, stats.failed, stats.avoided);
+    cliWrite(gBufferResp, len);
+}
+
+static void cliCmdBleLink(const ParseArgs* args)
+{
+    if(args->num > 1)
+    {
+        uint32_t seconds;
+        if(!cliArgNum(args, 1, 3600, &seconds))
+            return;
+        bleLinkSetIdleTimeout(seconds * 1000);
+    }
+
+    BLELinkStats stats = bleLinkGetStats();
+    int len = snprintf(gBufferResp, BUFFER_SIZE_RESP,
+                       "%s, interval %" PRIu32 " us, latency %u, idle after %" PRIu32 " ms, %" PRIu32 " transitions\r\n"
+                       "ms disconnected %" PRIu32 ", active %" PRIu32 ", idle %" PRIu32 "\r\n",
+                       bleLinkRegimeToName(stats.regime), (uint32_t)stats.interval * 1250, stats.latency,
+                       stats.idleTimeoutMs, stats.transitions,
+                       stats.regimeMs[BLELinkRegimeNone], stats.regimeMs[BLELinkRegimeActive],
+                       stats.regimeMs[BLELinkRegimeIdle]);
+    cliWrite(gBufferResp, len);
+}
+
+// the interval is ignored for sleep, which only waits <s> seconds between bursts
+static void cliCmdBleAdv(const ParseArgs* args)
+{
+    if(args->num == 2 || args->num == 3)
+    {
+        cliWriteStr(gCmdResponseBadArgs);
         return;
     }
 
-    if(strcmp(gCommand[0], gCmdColorAddRgb) == 0)
+    if(args->num > 1)
     {
-        Metadata meta =
+        BLEAdvPhase phase = bleStackAdvPhaseFromName(parseArg(args, 1));
+        if(phase >= BLEAdvPhaseOff)
         {
-            .type   = METADATA_TYPE_COLOR_RGB_NAMED,
-            .state  = METADATA_STATE_ACTIVE,
-            .length = 0
-        };
-        if(flashRecordCountMeta(1, meta) > 10)
+            cliWriteStr(gCmdResponseNoPhase);
+            return;
+        }
+
+        uint32_t intervalMs, durationS;
+        if(!cliArgNum(args, 2, 10240, &intervalMs) ||
+           !cliArgNum(args, 3, phase == BLEAdvPhaseSleep ? 3600 : 655, &durationS))
+            return;
+        if(phase != BLEAdvPhaseSleep && intervalMs < 20)
         {
-            app_usbd_cdc_acm_write(&usbdInstance, gCmdResponseNoSpace, sizeof(gCmdResponseNoSpace));
+            cliWriteStr(gCmdResponseBadValue);
             return;
         }
-        ColorRGB rgb =
+        bleStackAdvConfigure(phase, (BLEAdvPhaseConfig){intervalMs, durationS});
+    }
+
+    BLEAdvStats stats = bleStackAdvGetStats();
+    int len = snprintf(gBufferResp, BUFFER_SIZE_RESP, "advertising %s\r\n", bleStackAdvPhaseToName(stats.phase));
+    cliWrite(gBufferResp, len);
+    for(uint8_t phase = 0; phase < BLEAdvPhaseNum; ++phase)
+    {
+        len = snprintf(gBufferResp, BUFFER_SIZE_RESP, "%-5s %" PRIu32 " ms, %" PRIu32 " events, %" PRIu32 " ms radio\r\n",
+                       bleStackAdvPhaseToName(phase), stats.phases[phase].ms,
+                       stats.phases[phase].events, stats.phases[phase].radioMs);
+        cliWrite(gBufferResp, len);
+    }
+}
+
+static void cliCmdBcast(const ParseArgs* args)
+{
+    if(!BLE_OBSERVER_ENABLED)
+    {
+        cliWriteStr(gCmdResponseNoObserver);
+        return;
+    }
+
+    uint32_t group;
+    if(args->num > 1)
+    {
+        if(!cliArgNum(args, 1, UINT8_MAX, &group))
+            return;
+        bleObserverSetGroup(group);
+    }
+
+    BLEObserverStats stats = bleObserverGetStats();
+    int len = snprintf(gBufferResp, BUFFER_SIZE_RESP,
+                       "group %u, %" PRIu32 " reports: %" PRIu32 " applied, %" PRIu32 " duplicate, %" PRIu32 " bad mac, %" PRIu32 " other group\r\n",
+                       stats.group, stats.reports, stats.results[BcastResultAccepted],
+                       stats.results[BcastResultDuplicate], stats.results[BcastResultBadMAC],
+                       stats.results[BcastResultOtherGroup]);
+    cliWrite(gBufferResp, len);
+}
+
+// with a size starts a notification stream on the bulk characteristic, always prints the last runs
+static void cliCmdBleBulk(const ParseArgs* args)
+{
+    uint32_t bytes;
+    if(args->num > 1)
+    {
+        if(!cliArgNum(args, 1, UINT16_MAX, &bytes))
+            return;
+        if(!bleServiceBulkSend(bytes * 1024))
         {
-            .r = strtoul(gCommand[1], NULL, 10),
-            .g = strtoul(gCommand[2], NULL, 10),
-            .b = strtoul(gCommand[3], NULL, 10)
-        };
-        flashSaveColorRGBNamed(rgb, gCommand[4]);
+            cliWriteStr(gCmdResponseNoBulk);
+            return;
+        }
+    }
+
+    BLEBulkStats stats = bleServiceGetBulkStats();
+    int len = snprintf(gBufferResp, BUFFER_SIZE_RESP,
+                       "mtu %u, data length %u, phy %u\r\n"
+                       "rx %" PRIu32 " B in %" PRIu32 " chunks, %" PRIu32 " seq errors, %" PRIu32 " kB/s\r\n"
+                       "tx %" PRIu32 " B, %" PRIu32 " kB/s\r\n",
+                       stats.mtu, stats.dataLength, stats.phy,
+                       stats.rxBytes, stats.rxChunks, stats.rxSeqErrors, stats.rxKBps,
+                       stats.txBytes, stats.txKBps);
+    cliWrite(gBufferResp, len);
+}
+
+static void cliCmdBinary(const ParseArgs* args)
+{
+    if(cliWriteStr(gCmdResponseBinary))
+        cliSetMode(CliModeBinary);
+}
+
+static void cliCmdCliStats(const ParseArgs* args)
+{
+    int len = snprintf(gBufferResp, BUFFER_SIZE_RESP,
+                       "usb handler: %" PRIu32 " events, avg %" PRIu32 " us, max %" PRIu32 " us; lines: %" PRIu32 " executed, %" PRIu32 " dropped, %" PRIu32 " deferred; "
+                       "tx: %" PRIu32 " bytes, %" PRIu32 " writes dropped\r\n",
+                       gCliStats.events,
+                       gCliStats.events ? profCyclesToUs(gCliStats.cycles / gCliStats.events) : 0,
+                       profCyclesToUs(gCliStats.cyclesMax),
+                       gCliStats.lines, gCliStats.linesDropped, gCliStats.linesDeferred,
+                       gCliStats.txBytes, gCliStats.txDropped);
+    cliWrite(gBufferResp, len);
+}
+
+#define CLI_COMMAND_ENTRY(name, func, argcMin, argcMax) \
+    {name, sizeof(name) - 1, argcMin, argcMax, cliCmd##func},
+
+static const CliCommand gCliCommands[] =
+{
+    CMD_TABLE(CLI_COMMAND_ENTRY)
+};
+
+#define CLI_COMMAND_NUM (sizeof(gCliCommands) / sizeof(gCliCommands[0]))
+
+// the table is sorted by name, see CMD_TABLE
+static const CliCommand* cliCommandFind(const char* name, uint8_t len)
+{
+    uint8_t low  = 0;
+    uint8_t high = CLI_COMMAND_NUM;
+    while(low < high)
+    {
+        uint8_t mid = (low + high) / 2;
+        int     cmp = strncmp(name, gCliCommands[mid].name, len);
+        if(cmp == 0 && len < gCliCommands[mid].nameLen)
+            cmp = -1;
+        if(cmp == 0)
+            return &gCliCommands[mid];
+        if(cmp < 0)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return NULL;
+}
+
+static void cliExecCommand(const ParseArgs* args)
+{
+    if(args->num == 0)
+        return;
+
+    const CliCommand* cmd = cliCommandFind(parseArg(args, 0), args->tokens[0].length);
+    if(cmd == NULL)
+    {
+        cliWriteStr(gCmdResponseUnknownCmd);
         return;
     }
 
-    if(strcmp(gCommand[0], gCmdColorAddCur) == 0)
+    uint8_t argc = args->num - 1;
+    if(argc < cmd->argcMin || argc > cmd->argcMax)
     {
-        ColorRGB rgb = ledsGetLED2State();
-        flashSaveColorRGBNamed(rgb, gCommand[1]);
+        cliWriteStr(gCmdResponseBadArgs);
         return;
     }
 
-    if(strcmp(gCommand[0], gCmdColorSet) == 0)
+    cmd->handler(args);
+}
+
+void cliSetMode(CliMode mode)
+{
+    CRITICAL_REGION_ENTER();
+    gLineLen      = 0;
+    gLineCursor   = 0;
+    gLineOverflow = false;
+    gRxLastCR     = false;
+    gEscState     = CliEscNone;
+    frameReset();
+    gCliMode      = mode;
+    CRITICAL_REGION_EXIT();
+}
+
+// runs completed lines oldest first; while the TX ring is short on space the rest is held back
+// and EventCliLine is re-posted from TX_DONE, so handlers never see a partially written response
+void cliExecLines(void)
+{
+    if(gCliPortClosed)
+    {
+        gCliPortClosed = false;
+        cliFlashLoadAbort();
+    }
+
+    while(gCliStream != NULL || gLineTail != gLineHead)
     {
-        ColorRGB rgb;
-        FlashRetCode retCode = flashLoadColorRGBNamed(&rgb, gCommand[1]);
-        if(retCode == FlashRetCodeSuccess)
-            queueEventEnqueue((Event){EventChangeColorRGB, {.rgb = rgb}});
-        if(retCode == FlashRetCodeMetaNotFound)
-            app_usbd_cdc_acm_write(&usbdInstance, gCmdResponseNoColor, sizeof(gCmdResponseNoColor));
+        if(cliTxSpace() < CLI_TX_RESERVE)
+        {
+            ++gCliStats.linesDeferred;
+            gLineDeferred = true;
+            return;
+        }
+
+        // lines typed during a stream run after it completes
+        if(gCliStream != NULL)
+        {
+            if(!gCliStream())
+                gCliStream = NULL;
+            continue;
+        }
+
+        // commands separated by ';' run back to back from a single line
+        char* cmd = gLines[gLineTail];
+        while(cmd != NULL)
+        {
+            char* next = strchr(cmd, ';');
+            if(next != NULL)
+                *next++ = '\0';
+
+            ParseArgs args;
+            if(parseTokenize(&args, cmd))
+                cliExecCommand(&args);
+            else
+                cliWriteStr(gCmdResponseBadArgs);
+            cmd = next;
+        }
+
+        ++gCliStats.lines;
+        gLineTail = (gLineTail + 1) & (CLI_LINE_NUM - 1);
+    }
+}
+
+static void cliEchoFlush(void)
+{
+    cliWrite(gBufferEcho, gEchoLen);
+    gEchoLen = 0;
+}
+
+static void cliEcho(const char* data, size_t len)
+{
+    if(gEchoLen + len > BUFFER_SIZE_ECHO)
+        cliEchoFlush();
+    if(len > BUFFER_SIZE_ECHO)
+    {
+        cliWrite(data, len);
         return;
     }
+    memcpy(&gBufferEcho[gEchoLen], data, len);
+    gEchoLen += len;
+}
+
+static void cliEchoLeft(uint16_t num)
+{
+    char seq[8];
+    if(num > 0)
+        cliEcho(seq, snprintf(seq, sizeof(seq), "\x1b[%uD", num));
+}
 
-    if(strcmp(gCommand[0], gCmdColorDel) == 0)
+static void cliEditInsert(char c)
+{
+    char* line = gLines[gLineHead];
+    if(gLineLen + 1 >= BUFFER_SIZE_LINE)
     {
-        FlashRetCode retCode = flashDeleteColorRGBNamed(gCommand[1]);
-        if(retCode == FlashRetCodeMetaNotFound)
-            app_usbd_cdc_acm_write(&usbdInstance, gCmdResponseNoColor, sizeof(gCmdResponseNoColor));
+        gLineOverflow = true;
         return;
     }
 
-    if(strcmp(gCommand[0], "") != 0)
-        app_usbd_cdc_acm_write(&usbdInstance, gCmdResponseUnknownCmd, sizeof(gCmdResponseUnknownCmd));
+    memmove(&line[gLineCursor + 1], &line[gLineCursor], gLineLen - gLineCursor);
+    line[gLineCursor] = c;
+    ++gLineLen;
+
+    cliEcho(&line[gLineCursor], gLineLen - gLineCursor);
+    ++gLineCursor;
+    cliEchoLeft(gLineLen - gLineCursor);
 }
 
-static bool cliCRLF(void)
+static void cliEditBackspace(void)
 {
-    return gBufferEcho[0] == '\r' || gBufferEcho[0] == '\n';
+    char* line = gLines[gLineHead];
+    if(gLineCursor == 0)
+        return;
+
+    memmove(&line[gLineCursor - 1], &line[gLineCursor], gLineLen - gLineCursor);
+    --gLineCursor;
+    --gLineLen;
+
+    cliEcho("\b", 1);
+    cliEcho(&line[gLineCursor], gLineLen - gLineCursor);
+    cliEcho(" ", 1);
+    cliEchoLeft(gLineLen - gLineCursor + 1);
 }
 
-static void cliProcessInput(void)
+static void cliEditMove(int16_t delta)
 {
-    if(cliCRLF())
+    if(delta < 0 && gLineCursor > 0)
+    {
+        uint16_t num = -delta < gLineCursor ? -delta : gLineCursor;
+        cliEchoLeft(num);
+        gLineCursor -= num;
+    }
+    else if(delta > 0 && gLineCursor < gLineLen)
     {
-        app_usbd_cdc_acm_write(&usbdInstance, "\r\n", 2);
-        cliBufferParse();
-        cliExecCommand();
-        cliBufferReset();
+        uint16_t num = delta < gLineLen - gLineCursor ? delta : gLineLen - gLineCursor;
+        cliEcho(&gLines[gLineHead][gLineCursor], num);
+        gLineCursor += num;
     }
+}
+
+static void cliEditReplace(const char* text)
+{
+    cliEchoLeft(gLineCursor);
+    cliEcho("\x1b[K", 3);
+
+    gLineLen    = strlen(text);
+    gLineCursor = gLineLen;
+    memcpy(gLines[gLineHead], text, gLineLen);
+    cliEcho(text, gLineLen);
+}
+
+// history entries are numbered from 1 (most recent), 0 is the line being typed
+static void cliHistoryRecall(int8_t delta)
+{
+    uint8_t pos = gHistoryPos + delta;
+    if(delta < 0 ? gHistoryPos == 0 : gHistoryPos == gHistoryNum)
+        return;
+
+    gHistoryPos = pos;
+    if(pos == 0)
+        cliEditReplace("");
     else
+        cliEditReplace(gHistory[(gHistoryHead - pos) & (CLI_HISTORY_NUM - 1)]);
+}
+
+static void cliHistoryPush(const char* line, uint16_t len)
+{
+    const char* last = gHistory[(gHistoryHead - 1) & (CLI_HISTORY_NUM - 1)];
+    if(len == 0 || len >= CLI_HISTORY_LEN)
+        return;
+    if(gHistoryNum > 0 && strncmp(last, line, len) == 0 && last[len] == '\0')
+        return;
+
+    memcpy(gHistory[gHistoryHead], line, len);
+    gHistory[gHistoryHead][len] = '\0';
+    gHistoryHead = (gHistoryHead + 1) & (CLI_HISTORY_NUM - 1);
+    if(gHistoryNum < CLI_HISTORY_NUM)
+        ++gHistoryNum;
+}
+
+// completes the command name up to the longest common prefix of all matches,
+// candidates are listed when there is nothing left to complete
+static void cliEditComplete(void)
+{
+    char*             line  = gLines[gLineHead];
+    const CliCommand* first = NULL;
+    uint8_t           num   = 0;
+    uint8_t           common = 0;
+
+    if(gLineCursor != gLineLen || memchr(line, ' ', gLineLen) != NULL)
+        return;
+
+    for(uint8_t idx = 0; idx < CLI_COMMAND_NUM; ++idx)
+    {
+        const CliCommand* cmd = &gCliCommands[idx];
+        if(cmd->nameLen < gLineLen || strncmp(cmd->name, line, gLineLen) != 0)
+            continue;
+
+        if(first == NULL)
+        {
+            first  = cmd;
+            common = cmd->nameLen;
+        }
+        while(common > gLineLen && strncmp(cmd->name, first->name, common) != 0)
+            --common;
+        ++num;
+    }
+
+    if(num == 0)
+        return;
+
+    if(common > gLineLen)
+    {
+        for(uint8_t idx = gLineLen; idx < common; ++idx)
+            cliEditInsert(first->name[idx]);
+        if(num == 1)
+            cliEditInsert(' ');
+        return;
+    }
+
+    if(num == 1)
+    {
+        cliEditInsert(' ');
+        return;
+    }
+
+    cliEcho("\r\n", 2);
+    for(uint8_t idx = 0; idx < CLI_COMMAND_NUM; ++idx)
+    {
+        const CliCommand* cmd = &gCliCommands[idx];
+        if(cmd->nameLen >= gLineLen && strncmp(cmd->name, line, gLineLen) == 0)
+        {
+            cliEcho(cmd->name, cmd->nameLen);
+            cliEcho("  ", 2);
+        }
+    }
+    cliEcho("\r\n", 2);
+    cliEcho(line, gLineLen);
+}
+
+static void cliLineComplete(void)
+{
+    uint8_t head = (gLineHead + 1) & (CLI_LINE_NUM - 1);
+
+    cliHistoryPush(gLines[gLineHead], gLineLen);
+    gHistoryPos = 0;
+
+    // a truncated line could still parse into a valid but different command
+    if(gLineOverflow)
     {
-        cliBufferAppend();
-        app_usbd_cdc_acm_write(&usbdInstance, gBufferMain + strlen(gBufferMain) - 1, 1);
+        gLineOverflow = false;
+        gLineLen      = 0;
+        gLineCursor   = 0;
+        ++gCliStats.linesDropped;
+        cliEcho(gCmdResponseLineLong, sizeof(gCmdResponseLineLong) - 1);
+        return;
     }
+
+    if(gLineLen == 0)
+        return;
+
+    gLines[gLineHead][gLineLen] = '\0';
+    gLineLen    = 0;
+    gLineCursor = 0;
+
+    if(head == gLineTail)
+    {
+        ++gCliStats.linesDropped;
+        return;
+    }
+
+    queueEventEnqueue((Event){EventCliLine});
+    gLineHead = head;
+}
+
+static void cliEditEscape(char c)
+{
+    // keypads in application mode send ESC O <final> for the same keys as ESC [ <final>
+    if(gEscState == CliEscStart)
+    {
+        gEscState = c == '[' ? CliEscCSI : c == 'O' ? CliEscSS3 : CliEscNone;
+        return;
+    }
+
+    // CSI parameters such as in "3~" or "1;5C" are consumed and ignored
+    if(gEscState == CliEscCSI && ((c >= '0' && c <= '9') || c == ';'))
+        return;
+
+    gEscState = CliEscNone;
+    switch(c)
+    {
+    case 'A':
+        cliHistoryRecall(1);
+        break;
+
+    case 'B':
+        cliHistoryRecall(-1);
+        break;
+
+    case 'C':
+        cliEditMove(1);
+        break;
+
+    case 'D':
+        cliEditMove(-1);
+        break;
+
+    case 'H':
+        cliEditMove(-gLineCursor);
+        break;
+
+    case 'F':
+        cliEditMove(gLineLen - gLineCursor);
+        break;
+
+    default:
+        break;
+    }
+}
+
+// echo of a whole transfer is collected and written at once,
+// CR, LF and CRLF all complete the line with a single line break
+static void cliReceive(const char* data, size_t size)
+{
+    if(gCliMode == CliModeBinary)
+    {
+        size_t used = frameReceive((const uint8_t*)data, size);
+        data += used;
+        size -= used;
+    }
+
+    for(size_t idx = 0; idx < size; ++idx)
+    {
+        char c = data[idx];
+        bool cr = gRxLastCR;
+        gRxLastCR = c == '\r';
+
+        if(gEscState != CliEscNone)
+        {
+            cliEditEscape(c);
+            continue;
+        }
+
+        switch(c)
+        {
+        case '\r':
+        case '\n':
+            if(c == '\n' && cr)
+                break;
+            cliEcho("\r\n", 2);
+            cliLineComplete();
+            break;
+
+        case '\b':
+        case 0x7F:
+            cliEditBackspace();
+            break;
+
+        case '\t':
+            cliEditComplete();
+            break;
+
+        case 0x1B:
+            gEscState = CliEscStart;
+            break;
+
+        default:
+            if(c >= ' ')
+                cliEditInsert(c);
+            break;
+        }
+    }
+
+    cliEchoFlush();
 }
 
 static void usbdHandler(app_usbd_class_inst_t const* p_inst,
                         app_usbd_cdc_acm_user_event_t event)
 {
+    uint32_t cycles = profCycles();
+
     switch(event)
     {
     case APP_USBD_CDC_ACM_USER_EVT_PORT_OPEN:
-        app_usbd_cdc_acm_read(&usbdInstance, gBufferEcho, BUFFER_SIZE_ECHO);
+        app_usbd_cdc_acm_read_any(&usbdInstance, gBufferRx, BUFFER_SIZE_RX);
         break;
 
     case APP_USBD_CDC_ACM_USER_EVT_PORT_CLOSE:
+        CRITICAL_REGION_ENTER();
+        gTxHead     = 0;
+        gTxTail     = 0;
+        gTxInFlight = 0;
+        CRITICAL_REGION_EXIT();
+
+        // an upload left behind by the host is dropped from the main loop
+        gCliPortClosed = true;
+        gLineDeferred  = false;
+        queueEventEnqueue((Event){EventCliLine});
         break;
 
     case APP_USBD_CDC_ACM_USER_EVT_TX_DONE:
+        CRITICAL_REGION_ENTER();
+        gTxTail     = (gTxTail + gTxInFlight) & (BUFFER_SIZE_TX - 1);
+        gTxInFlight = 0;
+        cliTxKick();
+        CRITICAL_REGION_EXIT();
+
+        if(gLineDeferred && cliTxSpace() >= CLI_TX_RESERVE)
+        {
+            gLineDeferred = false;
+            queueEventEnqueue((Event){EventCliLine});
+        }
         break;
 
     case APP_USBD_CDC_ACM_USER_EVT_RX_DONE:
-        app_usbd_cdc_acm_read(&usbdInstance, gBufferEcho, BUFFER_SIZE_ECHO);
-        cliProcessInput();
+    {
+        // read_any returns NRF_SUCCESS as long as data is already buffered by the class
+        ret_code_t ret;
+        do
+        {
+            cliReceive(gBufferRx, app_usbd_cdc_acm_rx_size(&usbdInstance));
+            ret = app_usbd_cdc_acm_read_any(&usbdInstance, gBufferRx, BUFFER_SIZE_RX);
+        } while(ret == NRF_SUCCESS);
         break;
+    }
 
     default:
         break;
     }
+
+    cycles = profCycles() - cycles;
+    ++gCliStats.events;
+    gCliStats.cycles += cycles;
+    if(cycles > gCliStats.cyclesMax)
+        gCliStats.cyclesMax = cycles;
 }
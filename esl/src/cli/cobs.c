@@ -0,0 +1,42 @@
+#include "cobs.h"
+
+size_t cobsEncode(uint8_t* dst, const uint8_t* src, size_t len)
+{
+    size_t  codeIdx = 0;
+    size_t  dstIdx  = 1;
+    uint8_t code    = 1;
+    for(size_t idx = 0; idx < len; ++idx)
+    {
+        if(src[idx] != 0)
+        {
+            dst[dstIdx++] = src[idx];
+            ++code;
+        }
+        if(src[idx] == 0 || code == 0xFF)
+        {
+            dst[codeIdx] = code;
+            codeIdx      = dstIdx++;
+            code         = 1;
+        }
+    }
+    dst[codeIdx]  = code;
+    dst[dstIdx++] = 0;
+    return dstIdx;
+}
+
+size_t cobsDecode(uint8_t* data, size_t len)
+{
+    size_t src = 0;
+    size_t dst = 0;
+    while(src < len)
+    {
+        uint8_t code = data[src++];
+        if(code == 0 || src + code - 1 > len)
+            return 0;
+        for(uint8_t idx = 1; idx < code; ++idx)
+            data[dst++] = data[src++];
+        if(code != 0xFF && src < len)
+            data[dst++] = 0;
+    }
+    return dst;
+}
@@ -0,0 +1,195 @@
+#include <string.h>
+
+#include "app_util_platform.h"
+#include "crc16.h"
+
+#include "queue.h"
+#include "leds.h"
+#include "strip.h"
+#include "anim.h"
+#include "power.h"
+
+#include "frame.h"
+#include "cobs.h"
+#include "cli.h"
+
+typedef struct
+{
+    uint16_t start;
+    uint8_t  num;
+    ColorRGB rgb[FRAME_PIXEL_MAX];
+} FramePixels;
+
+static uint8_t  gFrameRx[FRAME_ENCODED_MAX];
+static uint16_t gFrameRxLen      = 0;
+static bool     gFrameRxOverflow = false;
+
+static uint8_t gFrameResp[FRAME_DECODED_MAX];
+static uint8_t gFrameTx[FRAME_ENCODED_MAX];
+
+// free-running slot counters, the USB handler advances the head and the main loop the tail
+static FramePixels      gFramePixels[FRAME_PIXEL_SLOTS];
+static volatile uint8_t gFramePixelsHead = 0;
+static volatile uint8_t gFramePixelsTail = 0;
+
+STATIC_ASSERT(sizeof(gFrameRx) + sizeof(gFrameResp) + sizeof(gFrameTx) + sizeof(gFramePixels) <= FRAME_RAM_BYTES,
+              "frame buffers exceed FRAME_RAM_BYTES");
+
+static void frameRespond(uint8_t seq, uint8_t op, FrameStatus status, const void* payload, uint8_t len)
+{
+    gFrameResp[0] = seq;
+    gFrameResp[1] = op | FRAME_OP_RESPONSE;
+    gFrameResp[2] = status;
+    if(len > 0)
+        memcpy(&gFrameResp[3], payload, len);
+
+    uint16_t size = 3 + len;
+    uint16_t crc  = crc16_compute(gFrameResp, size, NULL);
+    gFrameResp[size++] = crc & 0xFF;
+    gFrameResp[size++] = crc >> 8;
+
+    cliWrite((const char*)gFrameTx, cobsEncode(gFrameTx, gFrameResp, size));
+}
+
+// the strip belongs to the main loop, so the pixels are only copied here; a host sending
+// faster than frames are applied gets FrameStatusBusy and retries
+static FrameStatus frameExecSetPixels(const uint8_t* payload, uint8_t len)
+{
+    if((uint8_t)(gFramePixelsHead - gFramePixelsTail) == FRAME_PIXEL_SLOTS)
+        return FrameStatusBusy;
+
+    FramePixels* pixels = &gFramePixels[gFramePixelsHead % FRAME_PIXEL_SLOTS];
+    pixels->start = payload[0] | (payload[1] << 8);
+    pixels->num   = (len - 2) / 3;
+    for(uint8_t idx = 0; idx < pixels->num; ++idx)
+    {
+        const uint8_t* rgb = &payload[2 + 3 * idx];
+        pixels->rgb[idx] = (ColorRGB){.r = rgb[0], .g = rgb[1], .b = rgb[2]};
+    }
+    ++gFramePixelsHead;
+
+    queueEventEnqueue((Event){EventStripPixels});
+    return FrameStatusSuccess;
+}
+
+// returns false once the frame has handed the port back to the text CLI
+static bool frameExec(const uint8_t* frame, size_t len)
+{
+    uint8_t        seq     = frame[0];
+    uint8_t        op      = frame[1];
+    const uint8_t* payload = &frame[FRAME_HEADER_SIZE];
+    uint8_t        size    = len - FRAME_HEADER_SIZE - FRAME_CRC_SIZE;
+
+    uint16_t crc = frame[len - 2] | (frame[len - 1] << 8);
+    if(crc16_compute(frame, len - FRAME_CRC_SIZE, NULL) != crc)
+    {
+        frameRespond(seq, op, FrameStatusBadCRC, NULL, 0);
+        return true;
+    }
+
+    switch(op)
+    {
+    case FrameOpSetRGB:
+        if(size != 3)
+            break;
+        queueEventEnqueue((Event){EventChangeColorRGB, {.rgb = {.r = payload[0], .g = payload[1], .b = payload[2]}}});
+        frameRespond(seq, op, FrameStatusSuccess, NULL, 0);
+        return true;
+
+    case FrameOpSetHSV:
+        if(size != 3)
+            break;
+        queueEventEnqueue((Event){EventChangeColorHSV, {.hsv = {.h = payload[0], .s = payload[1], .v = payload[2]}}});
+        frameRespond(seq, op, FrameStatusSuccess, NULL, 0);
+        return true;
+
+    case FrameOpSetPixels:
+        if(size < 5 || (size - 2) % 3 != 0)
+            break;
+        frameRespond(seq, op, frameExecSetPixels(payload, size), NULL, 0);
+        return true;
+
+    case FrameOpState:
+    {
+        if(size != 0)
+            break;
+        ColorRGB rgb     = ledsGetLED2State();
+        uint8_t  state[] = {rgb.r, rgb.g, rgb.b, animIsRunning()};
+        frameRespond(seq, op, FrameStatusSuccess, state, sizeof(state));
+        return true;
+    }
+
+    case FrameOpTelemetry:
+    {
+        if(size != 0)
+            break;
+        AnimStats anim = animGetStats();
+        uint8_t   telemetry[sizeof(PowerTelemetry) + 3 * sizeof(uint32_t)];
+        memcpy(&telemetry[0], powerGetTelemetry(), sizeof(PowerTelemetry));
+        memcpy(&telemetry[sizeof(PowerTelemetry)], &anim.frames, sizeof(uint32_t));
+        memcpy(&telemetry[sizeof(PowerTelemetry) + 4], &anim.overruns, sizeof(uint32_t));
+        memcpy(&telemetry[sizeof(PowerTelemetry) + 8], &anim.maxUs, sizeof(uint32_t));
+        frameRespond(seq, op, FrameStatusSuccess, telemetry, sizeof(telemetry));
+        return true;
+    }
+
+    case FrameOpText:
+        frameRespond(seq, op, FrameStatusSuccess, NULL, 0);
+        cliSetMode(CliModeText);
+        return false;
+
+    default:
+        frameRespond(seq, op, FrameStatusBadOp, NULL, 0);
+        return true;
+    }
+
+    frameRespond(seq, op, FrameStatusBadLength, NULL, 0);
+    return true;
+}
+
+void frameReset(void)
+{
+    gFrameRxLen      = 0;
+    gFrameRxOverflow = false;
+}
+
+// frames are short and map onto queued events, so they are handled right in the USB handler;
+// decoding stops after a frame switching back to text, the bytes left belong to the text CLI
+size_t frameReceive(const uint8_t* data, size_t size)
+{
+    for(size_t idx = 0; idx < size; ++idx)
+    {
+        if(data[idx] != 0)
+        {
+            if(gFrameRxLen < FRAME_ENCODED_MAX)
+                gFrameRx[gFrameRxLen++] = data[idx];
+            else
+                gFrameRxOverflow = true;
+            continue;
+        }
+
+        size_t len  = gFrameRxOverflow ? 0 : cobsDecode(gFrameRx, gFrameRxLen);
+        bool   more = len < FRAME_HEADER_SIZE + FRAME_CRC_SIZE || frameExec(gFrameRx, len);
+        frameReset();
+        if(!more)
+            return idx + 1;
+    }
+    return size;
+}
+
+// runs from the main loop on EventStripPixels, the host owns the strip from here on
+void frameApplyPixels(void)
+{
+    if(gFramePixelsTail == gFramePixelsHead)
+        return;
+
+    animStop();
+    while(gFramePixelsTail != gFramePixelsHead)
+    {
+        const FramePixels* pixels = &gFramePixels[gFramePixelsTail % FRAME_PIXEL_SLOTS];
+        for(uint8_t idx = 0; idx < pixels->num; ++idx)
+            stripSetPixel(pixels->start + idx, pixels->rgb[idx]);
+        ++gFramePixelsTail;
+    }
+    stripCommit();
+}
@@ -0,0 +1,89 @@
+#include <stddef.h>
+
+#include "parse.h"
+
+// kept free of SDK dependencies, the CLI feeds it raw operator input
+
+// returns false when the line holds more tokens than fit or is too long for the spans
+bool parseTokenize(ParseArgs* args, char* line)
+{
+    uint16_t idx = 0;
+
+    args->line = line;
+    args->num  = 0;
+    while(true)
+    {
+        while(line[idx] == ' ')
+            ++idx;
+        if(line[idx] == '\0')
+            return true;
+        if(args->num == PARSE_TOKEN_NUM_MAX)
+            return false;
+
+        ParseToken* token = &args->tokens[args->num++];
+        token->offset = idx;
+        while(line[idx] != ' ' && line[idx] != '\0')
+            ++idx;
+        if(idx > UINT8_MAX)
+            return false;
+        token->length = idx - token->offset;
+
+        if(line[idx] != '\0')
+            line[idx++] = '\0';
+    }
+}
+
+char* parseArg(const ParseArgs* args, uint8_t idx)
+{
+    return &args->line[args->tokens[idx].offset];
+}
+
+// decimal digits only, rejects empty input and anything above max instead of truncating
+bool parseNumber(const char* str, uint32_t max, uint32_t* value)
+{
+    uint32_t result = 0;
+
+    if(*str == '\0')
+        return false;
+
+    for(; *str != '\0'; ++str)
+    {
+        if(*str < '0' || *str > '9')
+            return false;
+
+        uint8_t digit = *str - '0';
+        if(digit > max || result > (max - digit) / 10)
+            return false;
+        result = result * 10 + digit;
+    }
+
+    *value = result;
+    return true;
+}
+
+static int8_t parseHexDigit(char c)
+{
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool parseHex(uint8_t* dst, const char* hex, uint16_t len)
+{
+    if(len % 2 != 0)
+        return false;
+
+    for(uint16_t idx = 0; idx < len / 2; ++idx)
+    {
+        int8_t hi = parseHexDigit(hex[2 * idx]);
+        int8_t lo = parseHexDigit(hex[2 * idx + 1]);
+        if(hi < 0 || lo < 0)
+            return false;
+        dst[idx] = (hi << 4) | lo;
+    }
+    return true;
+}
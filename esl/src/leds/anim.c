@@ -0,0 +1,330 @@
+#include <string.h>
+
+#include "app_timer.h"
+#include "nrf_log.h"
+
+#include "anim.h"
+#include "leds.h"
+#include "strip.h"
+#include "queue.h"
+#include "prof.h"
+#include "wave.h"
+
+#define ANIM_FRAME_PERIOD_MS 20
+
+#ifndef ANIM_FRAME_BUDGET_US
+#define ANIM_FRAME_BUDGET_US 2000
+#endif
+
+// consecutive frames over budget after which the effect is stopped
+#define ANIM_OVERRUN_LIMIT 8
+
+#define ANIM_FRAME_LEN STRIP_PIXEL_NUM
+
+// streamed colors are buffered for this long before they are due, absorbs connection event jitter
+#define ANIM_STREAM_LEAD_MS 60
+
+// a color further off its slot than this re-anchors the sender clock
+#define ANIM_STREAM_RESYNC_MS 500
+
+// the stream effect completes once no color was due for this long
+#define ANIM_STREAM_IDLE_MS 2000
+
+// power of two, indexes wrap with a mask
+#define ANIM_STREAM_NUM  128
+#define ANIM_STREAM_MASK (ANIM_STREAM_NUM - 1)
+
+// returns false once the effect has completed
+typedef bool (*AnimRender)(ColorRGB* frame, uint16_t len, uint32_t t);
+
+typedef struct
+{
+    const char* name;
+    AnimRender  render;
+} AnimEffectDesc;
+
+// tsMs is in the sender's time base
+typedef struct
+{
+    uint16_t tsMs;
+    ColorRGB rgb;
+} AnimStreamEntry;
+
+APP_TIMER_DEF(gTimerAnimFrame);
+
+static ColorRGB gAnimFrame[ANIM_FRAME_LEN];
+
+static AnimEffect gAnimEffect    = AnimEffectNone;
+static uint16_t   gAnimPeriodMs  = 0;
+static uint32_t   gAnimTick      = 0;
+static ColorHSV   gAnimColor;
+static ColorRGB   gAnimColorFrom;
+
+static volatile bool gAnimFramePending  = false;
+static uint8_t       gAnimOverrunsInRow = 0;
+
+// filled from BLE event context, drained by the stream effect in the main loop
+static AnimStreamEntry   gAnimStream[ANIM_STREAM_NUM];
+static volatile uint16_t gAnimStreamHead         = 0;
+static volatile uint16_t gAnimStreamTail         = 0;
+static volatile bool     gAnimStreamStartPending = false;
+static bool              gAnimStreamSynced       = false;
+static uint16_t          gAnimStreamOffset       = 0;
+static uint32_t          gAnimStreamLastDue      = 0;
+
+static AnimStats gAnimStats =
+{
+    .budgetUs = ANIM_FRAME_BUDGET_US
+};
+
+static void animFill(ColorRGB* frame, uint16_t len, ColorRGB rgb)
+{
+    for(uint16_t idx = 0; idx < len; ++idx)
+        frame[idx] = rgb;
+}
+
+static bool animRenderRainbow(ColorRGB* frame, uint16_t len, uint32_t t)
+{
+    uint8_t hue = gAnimColor.h + ((t % gAnimPeriodMs) << 8) / gAnimPeriodMs;
+    for(uint16_t idx = 0; idx < len; ++idx)
+    {
+        ColorHSV hsv =
+        {
+            .h = hue + ((uint32_t)idx << 8) / len,
+            .s = gAnimColor.s,
+            .v = gAnimColor.v
+        };
+        frame[idx] = hsv2rgb(hsv);
+    }
+    return true;
+}
+
+static bool animRenderPulse(ColorRGB* frame, uint16_t len, uint32_t t)
+{
+    ColorHSV hsv = gAnimColor;
+    hsv.v = gAnimColor.v * waveRaisedCos(wavePhase(t, gAnimPeriodMs)) / UINT8_MAX;
+    animFill(frame, len, hsv2rgb(hsv));
+    return true;
+}
+
+static uint8_t animLerp(uint8_t from, uint8_t to, uint32_t t, uint32_t period)
+{
+    return from + ((int32_t)to - from) * (int32_t)t / (int32_t)period;
+}
+
+static bool animRenderFade(ColorRGB* frame, uint16_t len, uint32_t t)
+{
+    ColorRGB to = hsv2rgb(gAnimColor);
+    if(t >= gAnimPeriodMs)
+    {
+        animFill(frame, len, to);
+        return false;
+    }
+
+    ColorRGB rgb =
+    {
+        .r = animLerp(gAnimColorFrom.r, to.r, t, gAnimPeriodMs),
+        .g = animLerp(gAnimColorFrom.g, to.g, t, gAnimPeriodMs),
+        .b = animLerp(gAnimColorFrom.b, to.b, t, gAnimPeriodMs)
+    };
+    animFill(frame, len, rgb);
+    return true;
+}
+
+static bool animRenderStrobe(ColorRGB* frame, uint16_t len, uint32_t t)
+{
+    if(t % gAnimPeriodMs < gAnimPeriodMs / 4)
+        animFill(frame, len, hsv2rgb(gAnimColor));
+    else
+        animFill(frame, len, (ColorRGB){0});
+    return true;
+}
+
+// sender timestamps are mapped onto the effect clock with the first color plus a fixed lead,
+// every due color is consumed and the newest one is shown
+static bool animRenderStream(ColorRGB* frame, uint16_t len, uint32_t t)
+{
+    while(gAnimStreamTail != gAnimStreamHead)
+    {
+        AnimStreamEntry* entry = &gAnimStream[gAnimStreamTail & ANIM_STREAM_MASK];
+        int16_t          delta = (int16_t)(entry->tsMs + gAnimStreamOffset - (uint16_t)t);
+        if(!gAnimStreamSynced || delta > ANIM_STREAM_RESYNC_MS || delta < -ANIM_STREAM_RESYNC_MS)
+        {
+            if(gAnimStreamSynced)
+                ++gAnimStats.streamResyncs;
+            gAnimStreamSynced = true;
+            gAnimStreamOffset = (uint16_t)t + ANIM_STREAM_LEAD_MS - entry->tsMs;
+            delta             = ANIM_STREAM_LEAD_MS;
+        }
+
+        if(delta > 0)
+            break;
+
+        gAnimColorFrom     = entry->rgb;
+        gAnimStreamLastDue = t;
+        ++gAnimStreamTail;
+    }
+
+    animFill(frame, len, gAnimColorFrom);
+    if(t - gAnimStreamLastDue < ANIM_STREAM_IDLE_MS)
+        return true;
+
+    gAnimColor = rgb2hsv(gAnimColorFrom);
+    return false;
+}
+
+static const AnimEffectDesc gAnimEffects[AnimEffectNum] =
+{
+    [AnimEffectNone]    = {"off",     NULL},
+    [AnimEffectRainbow] = {"rainbow", animRenderRainbow},
+    [AnimEffectPulse]   = {"pulse",   animRenderPulse},
+    [AnimEffectFade]    = {"fade",    animRenderFade},
+    [AnimEffectStrobe]  = {"strobe",  animRenderStrobe},
+    [AnimEffectStream]  = {"stream",  animRenderStream}
+};
+
+// the timer only signals the main loop, rendering never runs in app_timer context
+static void animHandlerFrame(void* p_context)
+{
+    if(gAnimFramePending)
+        return;
+
+    gAnimFramePending = true;
+    queueEventEnqueue((Event){EventAnimFrame});
+}
+
+void animSetup(void)
+{
+    app_timer_create(&gTimerAnimFrame, APP_TIMER_MODE_REPEATED, animHandlerFrame);
+}
+
+void animStart(AnimParams params, ColorHSV color)
+{
+    if(params.effect == AnimEffectNone || params.effect >= AnimEffectNum)
+    {
+        animStop();
+        return;
+    }
+
+    gAnimEffect        = params.effect;
+    gAnimPeriodMs      = params.periodMs < ANIM_FRAME_PERIOD_MS ? ANIM_FRAME_PERIOD_MS : params.periodMs;
+    gAnimColor         = color;
+    gAnimColorFrom     = ledsGetLED2State();
+    gAnimTick          = 0;
+    gAnimOverrunsInRow = 0;
+
+    gAnimStreamSynced       = false;
+    gAnimStreamLastDue      = 0;
+    gAnimStreamStartPending = false;
+    if(gAnimEffect != AnimEffectStream)
+        gAnimStreamTail = gAnimStreamHead;
+
+    app_timer_stop(gTimerAnimFrame);
+    app_timer_start(gTimerAnimFrame, APP_TIMER_TICKS(ANIM_FRAME_PERIOD_MS), NULL);
+    NRF_LOG_INFO("Effect %s started, period %u ms", gAnimEffects[gAnimEffect].name, gAnimPeriodMs);
+}
+
+void animStop(void)
+{
+    app_timer_stop(gTimerAnimFrame);
+    gAnimEffect = AnimEffectNone;
+}
+
+bool animIsRunning(void)
+{
+    return gAnimEffect != AnimEffectNone;
+}
+
+void animSetColor(ColorHSV color)
+{
+    gAnimColor = color;
+}
+
+void animSetBudget(uint32_t budgetUs)
+{
+    gAnimStats.budgetUs = budgetUs;
+}
+
+static void animCommit(void)
+{
+    ledsSetLED2StateRGB(gAnimFrame[0]);
+    stripSetFrame(gAnimFrame, ANIM_FRAME_LEN);
+    stripCommit();
+}
+
+void animProcessFrame(void)
+{
+    gAnimFramePending = false;
+    if(gAnimEffect == AnimEffectNone)
+        return;
+
+    uint32_t cycles  = profCycles();
+    bool     running = gAnimEffects[gAnimEffect].render(gAnimFrame, ANIM_FRAME_LEN, gAnimTick++ * ANIM_FRAME_PERIOD_MS);
+    animCommit();
+    uint32_t us = profCyclesToUs(profCycles() - cycles);
+
+    ++gAnimStats.frames;
+    gAnimStats.lastUs = us;
+    if(us > gAnimStats.maxUs)
+        gAnimStats.maxUs = us;
+
+    if(us > gAnimStats.budgetUs)
+    {
+        ++gAnimStats.overruns;
+        if(++gAnimOverrunsInRow >= ANIM_OVERRUN_LIMIT)
+        {
+            NRF_LOG_WARNING("Effect %s exceeded frame budget (%u us), stopped", gAnimEffects[gAnimEffect].name, us);
+            animStop();
+            return;
+        }
+    }
+    else
+        gAnimOverrunsInRow = 0;
+
+    if(!running)
+    {
+        animStop();
+        queueEventEnqueue((Event){EventChangeColorHSV, {.hsv = gAnimColor}});
+    }
+}
+
+AnimStats animGetStats(void)
+{
+    return gAnimStats;
+}
+
+// single producer, called from BLE event context; the first batch starts the stream effect
+// through the event queue, returns the number of colors accepted
+uint8_t animStreamPush(uint16_t tsMs, uint8_t intervalMs, const ColorRGB* colors, uint8_t num)
+{
+    uint8_t cnt = 0;
+    for(; cnt < num && (uint16_t)(gAnimStreamHead - gAnimStreamTail) < ANIM_STREAM_NUM; ++cnt)
+    {
+        gAnimStream[gAnimStreamHead & ANIM_STREAM_MASK] = (AnimStreamEntry){tsMs + cnt * intervalMs, colors[cnt]};
+        ++gAnimStreamHead;
+    }
+    gAnimStats.streamColors  += cnt;
+    gAnimStats.streamDropped += num - cnt;
+
+    if(gAnimEffect != AnimEffectStream && !gAnimStreamStartPending)
+    {
+        gAnimStreamStartPending = true;
+        queueEventEnqueue((Event){EventAnimStart, {.anim = {AnimEffectStream, 0}}});
+    }
+    return cnt;
+}
+
+AnimEffect animEffectFromName(const char* name)
+{
+    for(uint8_t effect = 0; effect < AnimEffectNum; ++effect)
+        if(strcmp(name, gAnimEffects[effect].name) == 0)
+            return effect;
+    return AnimEffectNum;
+}
+
+const char* animEffectToName(AnimEffect effect)
+{
+    if(effect >= AnimEffectNum)
+        return "";
+    return gAnimEffects[effect].name;
+}
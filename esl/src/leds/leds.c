@@ -1,10 +1,11 @@
-#include <math.h>
-
 #include "app_timer.h"
+#include "app_util_platform.h"
 #include "nrf_gpio.h"
 #include "nrfx_pwm.h"
 
 #include "leds.h"
+#include "wave.h"
+#include "power.h"
 
 #define LED1_G_PRT 0
 #define LED1_G_PIN 6
@@ -22,12 +23,19 @@
 #define LED1_FLASH_PERIOD_SLOW_MS 2000
 #define LED1_FLASH_PERIOD_FAST_MS 500
 
-#define LED1_SHIFT_PERIOD_MS 1
+// longer than the ~2ms PWM period, so each step finds the previous swap picked up by the hardware
+// and the breathing runs without SEQEND interrupts
+#define LED1_SHIFT_PERIOD_MS 4
+
+// current drawn by each channel at 100% duty
+#define LED1_G_CURRENT_UA 5000
+#define LED2_R_CURRENT_UA 5000
+#define LED2_G_CURRENT_UA 5000
+#define LED2_B_CURRENT_UA 5000
 
 APP_TIMER_DEF(gTimerLED1Shift);
 
-static uint16_t gLED1FlashPeriod = LED1_FLASH_PERIOD_DFLT_MS;
-static uint64_t gLED1ShiftTick   = 0;
+static Wave gLED1Wave;
 
 static uint8_t  gLED1State = 0;
 static ColorRGB gLED2State =
@@ -37,22 +45,23 @@ static ColorRGB gLED2State =
     .b = 0
 };
 
-static nrf_pwm_values_individual_t gPWMSeqValues = 
-{
-    .channel_0 = 0,
-    .channel_1 = 0,
-    .channel_2 = 0,
-    .channel_3 = 0
-};
+// setters write the staged values, commits copy them into the back buffer and point both
+// sequences at it; the hardware latches the pointer at the next sequence start
+static nrf_pwm_values_individual_t gPWMSeqStaged;
+static nrf_pwm_values_individual_t gPWMSeqValues[2];
 static const nrf_pwm_sequence_t gPWMSeq =
 {
-    .values.p_individual = &gPWMSeqValues,
-    .length              = NRF_PWM_VALUES_LENGTH(gPWMSeqValues),
+    .values.p_individual = &gPWMSeqValues[0],
+    .length              = NRF_PWM_VALUES_LENGTH(gPWMSeqValues[0]),
     .repeats             = 0,
     .end_delay           = 0
 };
 
-// gPWMTopValue = 1020 so that PWM period = 1020/1e6 ~ 1ms, and 1020/UINT8_MAX is integer
+static volatile uint8_t gPWMSeqFront   = 0;
+static volatile bool    gPWMSwapDirty  = false;
+static volatile uint8_t gPWMBatchDepth = 0;
+
+// gPWMTopValue = 1020 so that PWM period = 2 * 1020/1e6 ~ 2ms counting up and down, and 1020/UINT8_MAX is integer
 static const uint16_t          gPWMTopValue = 1020;
 static const nrfx_pwm_t        gPWMInstance = NRFX_PWM_INSTANCE(0);
 static const nrfx_pwm_config_t gPWMConfig   =
@@ -120,10 +129,118 @@ LogicalState ledsGetLEDState(char color)
     return nrf_gpio_pin_out_read(ledsColor2Pin(color)) == 0 ? LogicalStateOn : LogicalStateOff;
 }
 
+// a stale SEQEND only makes the handler check the hardware state once more
+static void ledsPWMSeqIntEnable(bool enable)
+{
+    if(enable)
+        nrf_pwm_int_enable(gPWMInstance.p_registers, NRF_PWM_INT_SEQEND0_MASK | NRF_PWM_INT_SEQEND1_MASK);
+    else
+        nrf_pwm_int_disable(gPWMInstance.p_registers, NRF_PWM_INT_SEQEND0_MASK | NRF_PWM_INT_SEQEND1_MASK);
+}
+
+// SEQSTARTED is cleared whenever the pointers change, once either sequence has started again
+// the hardware plays the front buffer and the other one is free
+static bool ledsPWMSeqSettled(void)
+{
+    return nrf_pwm_event_check(gPWMInstance.p_registers, NRF_PWM_EVENT_SEQSTARTED0) ||
+           nrf_pwm_event_check(gPWMInstance.p_registers, NRF_PWM_EVENT_SEQSTARTED1);
+}
+
+static uint32_t ledsEstimateCurrent(const nrf_pwm_values_individual_t* values)
+{
+    return (values->channel_0 * LED1_G_CURRENT_UA +
+            values->channel_1 * LED2_R_CURRENT_UA +
+            values->channel_2 * LED2_G_CURRENT_UA +
+            values->channel_3 * LED2_B_CURRENT_UA) / gPWMTopValue;
+}
+
+static uint16_t ledsScaleDuty(uint16_t duty, uint16_t scale)
+{
+    return ((uint32_t)duty * scale) >> 8;
+}
+
+// the power limiter is applied on the way from the staged to the back buffer
+static void ledsPWMSeqStage(nrf_pwm_values_individual_t* back)
+{
+    uint16_t scale = powerUpdate(PowerSourceOnboard, 0, ledsEstimateCurrent(&gPWMSeqStaged));
+
+    back->channel_0 = ledsScaleDuty(gPWMSeqStaged.channel_0, scale);
+    back->channel_1 = ledsScaleDuty(gPWMSeqStaged.channel_1, scale);
+    back->channel_2 = ledsScaleDuty(gPWMSeqStaged.channel_2, scale);
+    back->channel_3 = ledsScaleDuty(gPWMSeqStaged.channel_3, scale);
+}
+
+// called with interrupts masked; while the previous swap has not been picked up by the hardware
+// the old front may still be playing, the swap is then retried from SEQEND
+static void ledsPWMSwap(void)
+{
+    if(!ledsPWMSeqSettled())
+    {
+        gPWMSwapDirty = true;
+        ledsPWMSeqIntEnable(true);
+        return;
+    }
+
+    uint8_t back = gPWMSeqFront ^ 1;
+    ledsPWMSeqStage(&gPWMSeqValues[back]);
+    nrf_pwm_seq_ptr_set(gPWMInstance.p_registers, 0, (const uint16_t*)&gPWMSeqValues[back]);
+    nrf_pwm_seq_ptr_set(gPWMInstance.p_registers, 1, (const uint16_t*)&gPWMSeqValues[back]);
+    // a sequence starting right before the clear is missed, which only delays the next swap
+    nrf_pwm_event_clear(gPWMInstance.p_registers, NRF_PWM_EVENT_SEQSTARTED0);
+    nrf_pwm_event_clear(gPWMInstance.p_registers, NRF_PWM_EVENT_SEQSTARTED1);
+    gPWMSeqFront  = back;
+    gPWMSwapDirty = false;
+}
+
+// SEQEND only matters while a swap waits for the hardware, a batch in progress commits on its own
+static void ledsHandlerPWM(nrfx_pwm_evt_type_t event)
+{
+    if(event != NRFX_PWM_EVT_END_SEQ0 && event != NRFX_PWM_EVT_END_SEQ1)
+        return;
+
+    CRITICAL_REGION_ENTER();
+    if(gPWMSwapDirty && gPWMBatchDepth == 0)
+        ledsPWMSwap();
+    if(!gPWMSwapDirty || gPWMBatchDepth > 0)
+        ledsPWMSeqIntEnable(false);
+    CRITICAL_REGION_EXIT();
+}
+
 void ledsSetupPWM(void)
 {
-    nrfx_pwm_init(&gPWMInstance, &gPWMConfig, NULL);
-    nrfx_pwm_simple_playback(&gPWMInstance, &gPWMSeq, 1, NRFX_PWM_FLAG_LOOP);
+    nrfx_pwm_init(&gPWMInstance, &gPWMConfig, ledsHandlerPWM);
+    nrfx_pwm_simple_playback(&gPWMInstance, &gPWMSeq, 1,
+                             NRFX_PWM_FLAG_LOOP | NRFX_PWM_FLAG_SIGNAL_END_SEQ0 | NRFX_PWM_FLAG_SIGNAL_END_SEQ1);
+    ledsPWMSeqIntEnable(false);
+}
+
+static void ledsCommit(void)
+{
+    CRITICAL_REGION_ENTER();
+    ledsPWMSwap();
+    CRITICAL_REGION_EXIT();
+}
+
+static void ledsCommitUnlessBatched(void)
+{
+    if(gPWMBatchDepth == 0)
+        ledsCommit();
+}
+
+void ledsBatchBegin(void)
+{
+    CRITICAL_REGION_ENTER();
+    ++gPWMBatchDepth;
+    CRITICAL_REGION_EXIT();
+}
+
+void ledsBatchEnd(void)
+{
+    CRITICAL_REGION_ENTER();
+    if(gPWMBatchDepth > 0)
+        --gPWMBatchDepth;
+    CRITICAL_REGION_EXIT();
+    ledsCommitUnlessBatched();
 }
 
 ColorRGB ledsGetLED2State(void)
@@ -133,14 +250,18 @@ ColorRGB ledsGetLED2State(void)
 
 static void ledsUpdatePWMSeqValuesLED1(void)
 {
-    gPWMSeqValues.channel_0 = gPWMTopValue * gLED1State / UINT8_MAX;
+    gPWMSeqStaged.channel_0 = gPWMTopValue * gLED1State / UINT8_MAX;
+    ledsCommitUnlessBatched();
 }
 
 static void ledsUpdatePWMSeqValuesLED2(void)
 {
-    gPWMSeqValues.channel_1 = gPWMTopValue * gLED2State.r / UINT8_MAX;
-    gPWMSeqValues.channel_2 = gPWMTopValue * gLED2State.g / UINT8_MAX;
-    gPWMSeqValues.channel_3 = gPWMTopValue * gLED2State.b / UINT8_MAX;
+    CRITICAL_REGION_ENTER();
+    gPWMSeqStaged.channel_1 = gPWMTopValue * gLED2State.r / UINT8_MAX;
+    gPWMSeqStaged.channel_2 = gPWMTopValue * gLED2State.g / UINT8_MAX;
+    gPWMSeqStaged.channel_3 = gPWMTopValue * gLED2State.b / UINT8_MAX;
+    CRITICAL_REGION_EXIT();
+    ledsCommitUnlessBatched();
 }
 
 void ledsSetLED1State(uint8_t state)
@@ -163,8 +284,8 @@ void ledsSetLED2StateHSV(ColorHSV hsv)
 
 static void ledsShiftLED1State(void)
 {
-    // cos() is used for automatic periodic behavior
-    gLED1State = UINT8_MAX * (0.5 - 0.5 * cos(2 * M_PI * gLED1ShiftTick++ * LED1_SHIFT_PERIOD_MS / gLED1FlashPeriod));
+    // raised cosine is used for automatic periodic behavior
+    gLED1State = waveRaisedCos(waveAdvance(&gLED1Wave));
     ledsUpdatePWMSeqValuesLED1();
 }
 
@@ -178,23 +299,31 @@ void ledsSetupLED1Timer(void)
     app_timer_create(&gTimerLED1Shift, APP_TIMER_MODE_REPEATED, ledsHandlerLED1Shift);
 }
 
+void ledsFlashLED1Period(uint16_t periodMs)
+{
+    if(periodMs < LED1_SHIFT_PERIOD_MS)
+        periodMs = LED1_SHIFT_PERIOD_MS;
+
+    waveSetup(&gLED1Wave, periodMs, LED1_SHIFT_PERIOD_MS);
+    app_timer_start(gTimerLED1Shift, APP_TIMER_TICKS(LED1_SHIFT_PERIOD_MS), NULL);
+}
+
 void ledsFlashLED1(FlashMode mode)
 {
-    gLED1ShiftTick = 0;
     switch(mode)
     {
     case FlashModeSlow:
-        gLED1FlashPeriod = LED1_FLASH_PERIOD_SLOW_MS;
+        ledsFlashLED1Period(LED1_FLASH_PERIOD_SLOW_MS);
         break;
 
     case FlashModeFast:
-        gLED1FlashPeriod = LED1_FLASH_PERIOD_FAST_MS;
+        ledsFlashLED1Period(LED1_FLASH_PERIOD_FAST_MS);
         break;
 
     default:
+        ledsFlashLED1Period(LED1_FLASH_PERIOD_DFLT_MS);
         break;
     }
-    app_timer_start(gTimerLED1Shift, APP_TIMER_TICKS(LED1_SHIFT_PERIOD_MS), NULL);
 }
 
 void ledsFlashLED1Halt(void)
@@ -0,0 +1,104 @@
+#include "app_util_platform.h"
+
+#include "power.h"
+
+#ifndef POWER_BUDGET_MA
+#define POWER_BUDGET_MA 400
+#endif
+
+// MCU, radio and regulator draw, taken off the budget before any LED current
+#ifndef POWER_BOARD_UA
+#define POWER_BOARD_UA 10000
+#endif
+
+// idle current cannot be dimmed, only the dynamic part of an estimate is scaled
+static uint32_t gPowerIdleUA[PowerSourceNum];
+static uint32_t gPowerDynamicUA[PowerSourceNum];
+
+static PowerStats gPowerStats =
+{
+    .budgetMA = POWER_BUDGET_MA,
+    .scale    = POWER_SCALE_UNITY
+};
+
+static PowerTelemetry gPowerTelemetry =
+{
+    .budgetMA = POWER_BUDGET_MA,
+    .scale    = POWER_SCALE_UNITY
+};
+
+static uint16_t powerSaturate(uint32_t value)
+{
+    return value > UINT16_MAX ? UINT16_MAX : value;
+}
+
+// the dynamic current of every source is scaled by the same factor so that it fits into what
+// the fixed draw leaves of the budget; LEDs go dark when the fixed draw alone exceeds it
+static void powerLimit(void)
+{
+    uint32_t fixedUA   = POWER_BOARD_UA;
+    uint32_t dynamicUA = 0;
+    for(uint8_t source = 0; source < PowerSourceNum; ++source)
+    {
+        fixedUA   += gPowerIdleUA[source];
+        dynamicUA += gPowerDynamicUA[source];
+    }
+
+    uint32_t budgetUA = gPowerStats.budgetMA * 1000;
+    uint16_t scale    = POWER_SCALE_UNITY;
+    if(fixedUA >= budgetUA)
+        scale = 0;
+    else if(dynamicUA > budgetUA - fixedUA)
+        scale = ((uint64_t)(budgetUA - fixedUA) << 8) / dynamicUA;
+
+    gPowerStats.estimateUA = fixedUA + dynamicUA;
+    gPowerStats.fixedUA    = fixedUA;
+    gPowerStats.drawnUA    = fixedUA + (((uint64_t)dynamicUA * scale) >> 8);
+    gPowerStats.scale      = scale;
+
+    gPowerTelemetry.estimateMA = powerSaturate(gPowerStats.estimateUA / 1000);
+    gPowerTelemetry.drawnMA    = powerSaturate(gPowerStats.drawnUA / 1000);
+    gPowerTelemetry.budgetMA   = powerSaturate(gPowerStats.budgetMA);
+    gPowerTelemetry.scale      = scale;
+}
+
+uint16_t powerUpdate(PowerSource source, uint32_t idleUA, uint32_t dynamicUA)
+{
+    uint16_t scale;
+
+    CRITICAL_REGION_ENTER();
+    gPowerIdleUA[source]    = idleUA;
+    gPowerDynamicUA[source] = dynamicUA;
+    powerLimit();
+    scale = gPowerStats.scale;
+    ++gPowerStats.commits;
+    if(scale < POWER_SCALE_UNITY)
+        ++gPowerStats.commitsLimited;
+    CRITICAL_REGION_EXIT();
+
+    return scale;
+}
+
+void powerSetBudget(uint32_t budgetMA)
+{
+    CRITICAL_REGION_ENTER();
+    gPowerStats.budgetMA = budgetMA;
+    powerLimit();
+    CRITICAL_REGION_EXIT();
+}
+
+PowerStats powerGetStats(void)
+{
+    PowerStats stats;
+
+    CRITICAL_REGION_ENTER();
+    stats = gPowerStats;
+    CRITICAL_REGION_EXIT();
+
+    return stats;
+}
+
+PowerTelemetry* powerGetTelemetry(void)
+{
+    return &gPowerTelemetry;
+}
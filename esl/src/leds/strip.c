@@ -0,0 +1,249 @@
+#include <string.h>
+
+#include "app_util_platform.h"
+#include "nrf_gpio.h"
+#include "nrfx_pwm.h"
+
+#include "strip.h"
+#include "ws2812.h"
+#include "power.h"
+#include "queue.h"
+
+#define STRIP_DIN_PRT 0
+#define STRIP_DIN_PIN 29
+
+// number of pixels encoded into each half of the DMA buffer,
+// one half is refilled by the CPU while EasyDMA streams the other one
+#ifndef STRIP_CHUNK_PIXELS
+#define STRIP_CHUNK_PIXELS 32
+#endif
+
+#define STRIP_CHUNK_SLOTS    (STRIP_CHUNK_PIXELS * WS2812_BITS_PER_PIXEL)
+#define STRIP_DATA_CHUNKS    ((STRIP_PIXEL_NUM + STRIP_CHUNK_PIXELS - 1) / STRIP_CHUNK_PIXELS)
+#define STRIP_RESET_CHUNKS   ((WS2812_RESET_SLOTS + STRIP_CHUNK_SLOTS - 1) / STRIP_CHUNK_SLOTS)
+#define STRIP_TOTAL_CHUNKS   (STRIP_DATA_CHUNKS + STRIP_RESET_CHUNKS)
+
+// current drawn by one color channel at full brightness and by an idle pixel
+#define STRIP_CHANNEL_CURRENT_UA 12000
+#define STRIP_PIXEL_IDLE_UA      1000
+
+#define STRIP_IDLE_UA (STRIP_FITTED ? STRIP_PIXEL_NUM * STRIP_PIXEL_IDLE_UA : 0)
+
+// setters write the back frame, the front one is encoded by the PWM handler;
+// they are swapped by stripCommit from the main loop only, never while a transfer runs.
+// frames and PWM chunks double as one scratch block while the strip is suspended
+typedef union
+{
+    struct
+    {
+        ColorRGB                frames[2][STRIP_PIXEL_NUM];
+        nrf_pwm_values_common_t seqValues[2][STRIP_CHUNK_SLOTS];
+    } strip;
+    uint8_t scratch[STRIP_SCRATCH_BYTES];
+} StripMemory;
+
+static StripMemory      gStripMem;
+static volatile uint8_t gStripFront     = 0;
+static volatile bool    gStripSuspended = false;
+
+#define STRIP_BACK (gStripMem.strip.frames[gStripFront ^ 1])
+static const nrf_pwm_sequence_t gStripSeq[2] =
+{
+    {
+        .values.p_common = gStripMem.strip.seqValues[0],
+        .length          = STRIP_CHUNK_SLOTS,
+        .repeats         = 0,
+        .end_delay       = 0
+    },
+    {
+        .values.p_common = gStripMem.strip.seqValues[1],
+        .length          = STRIP_CHUNK_SLOTS,
+        .repeats         = 0,
+        .end_delay       = 0
+    }
+};
+
+static volatile bool     gStripBusy      = false;
+static volatile bool     gStripPending   = false;
+static volatile uint16_t gStripChunkNext = 0;
+static volatile uint16_t gStripScale     = POWER_SCALE_UNITY;
+
+static const nrfx_pwm_t        gStripPWMInstance = NRFX_PWM_INSTANCE(1);
+static const nrfx_pwm_config_t gStripPWMConfig   =
+{
+    .output_pins =
+    {
+        NRF_GPIO_PIN_MAP(STRIP_DIN_PRT, STRIP_DIN_PIN),
+        NRFX_PWM_PIN_NOT_USED,
+        NRFX_PWM_PIN_NOT_USED,
+        NRFX_PWM_PIN_NOT_USED
+    },
+    .irq_priority = APP_IRQ_PRIORITY_MID,
+    .base_clock   = NRF_PWM_CLK_16MHz,
+    .count_mode   = NRF_PWM_MODE_UP,
+    .top_value    = WS2812_PWM_TOP,
+    .load_mode    = NRF_PWM_LOAD_COMMON,
+    .step_mode    = NRF_PWM_STEP_AUTO
+};
+
+// slots past the last pixel hold the reset level
+static void stripEncodeChunk(uint16_t* dst, uint16_t chunkIdx)
+{
+    uint32_t  pixelIdx = (uint32_t)chunkIdx * STRIP_CHUNK_PIXELS;
+    uint16_t* end      = dst + STRIP_CHUNK_SLOTS;
+    uint16_t  num      = 0;
+    if(pixelIdx < STRIP_PIXEL_NUM)
+        num = STRIP_PIXEL_NUM - pixelIdx < STRIP_CHUNK_PIXELS ? STRIP_PIXEL_NUM - pixelIdx : STRIP_CHUNK_PIXELS;
+
+    dst = ws2812EncodePixels(dst, &gStripMem.strip.frames[gStripFront][pixelIdx], num, gStripScale);
+    ws2812EncodeIdle(dst, end);
+}
+
+static uint32_t stripEstimateCurrent(void)
+{
+    const ColorRGB* frame = gStripMem.strip.frames[gStripFront];
+    uint32_t        level = 0;
+    for(uint16_t idx = 0; idx < STRIP_PIXEL_NUM; ++idx)
+        level += frame[idx].r + frame[idx].g + frame[idx].b;
+
+    return (uint64_t)level * STRIP_CHANNEL_CURRENT_UA / UINT8_MAX;
+}
+
+static void stripStart(void)
+{
+    gStripBusy    = true;
+    gStripPending = false;
+    gStripScale   = powerUpdate(PowerSourceStrip, STRIP_IDLE_UA, STRIP_FITTED ? stripEstimateCurrent() : 0);
+
+    stripEncodeChunk(gStripMem.strip.seqValues[0], 0);
+    stripEncodeChunk(gStripMem.strip.seqValues[1], 1);
+    gStripChunkNext = 2;
+
+    nrfx_pwm_complex_playback(&gStripPWMInstance, &gStripSeq[0], &gStripSeq[1],
+                              (STRIP_TOTAL_CHUNKS + 1) / 2,
+                              NRFX_PWM_FLAG_STOP | NRFX_PWM_FLAG_SIGNAL_END_SEQ0 | NRFX_PWM_FLAG_SIGNAL_END_SEQ1);
+}
+
+static void stripHandlerPWM(nrfx_pwm_evt_type_t event)
+{
+    if(gStripSuspended)
+        return;
+
+    switch(event)
+    {
+    case NRFX_PWM_EVT_END_SEQ0:
+        stripEncodeChunk(gStripMem.strip.seqValues[0], gStripChunkNext++);
+        break;
+
+    case NRFX_PWM_EVT_END_SEQ1:
+        stripEncodeChunk(gStripMem.strip.seqValues[1], gStripChunkNext++);
+        break;
+
+    // the swap is left to the main loop, the back frame may be half written right now
+    case NRFX_PWM_EVT_FINISHED:
+        gStripBusy = false;
+        if(gStripPending)
+        {
+            gStripPending = false;
+            queueEventEnqueue((Event){EventStripCommit});
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void stripSetup(void)
+{
+    nrf_gpio_cfg_output(NRF_GPIO_PIN_MAP(STRIP_DIN_PRT, STRIP_DIN_PIN));
+    nrf_gpio_pin_write(NRF_GPIO_PIN_MAP(STRIP_DIN_PRT, STRIP_DIN_PIN), 0);
+    nrfx_pwm_init(&gStripPWMInstance, &gStripPWMConfig, stripHandlerPWM);
+}
+
+uint16_t stripGetPixelNum(void)
+{
+    return STRIP_PIXEL_NUM;
+}
+
+void stripSetPixel(uint16_t idx, ColorRGB rgb)
+{
+    if(idx < STRIP_PIXEL_NUM && !gStripSuspended)
+        STRIP_BACK[idx] = rgb;
+}
+
+ColorRGB stripGetPixel(uint16_t idx)
+{
+    if(idx < STRIP_PIXEL_NUM && !gStripSuspended)
+        return STRIP_BACK[idx];
+    return (ColorRGB){0};
+}
+
+void stripSetFrame(const ColorRGB* frame, uint16_t len)
+{
+    if(gStripSuspended)
+        return;
+    memcpy(STRIP_BACK, frame, sizeof(ColorRGB) * (len < STRIP_PIXEL_NUM ? len : STRIP_PIXEL_NUM));
+}
+
+void stripFill(ColorRGB rgb)
+{
+    if(gStripSuspended)
+        return;
+    for(uint16_t idx = 0; idx < STRIP_PIXEL_NUM; ++idx)
+        STRIP_BACK[idx] = rgb;
+}
+
+// main loop only; a commit issued while a frame is streaming is replayed through EventStripCommit
+// once it finishes, the new front is copied back so partial updates build on the latest frame
+void stripCommit(void)
+{
+    bool swapped = false;
+    if(gStripSuspended)
+        return;
+
+    CRITICAL_REGION_ENTER();
+    if(gStripBusy)
+        gStripPending = true;
+    else
+    {
+        gStripFront ^= 1;
+        swapped      = true;
+        stripStart();
+    }
+    CRITICAL_REGION_EXIT();
+
+    if(swapped)
+        memcpy(STRIP_BACK, gStripMem.strip.frames[gStripFront], sizeof(gStripMem.strip.frames[0]));
+}
+
+bool stripIsBusy(void)
+{
+    return gStripBusy;
+}
+
+// a transfer in progress is cut short, the pixels keep whatever they latched last
+uint8_t* stripSuspend(void)
+{
+    if(!gStripSuspended)
+    {
+        nrfx_pwm_stop(&gStripPWMInstance, true);
+        CRITICAL_REGION_ENTER();
+        gStripSuspended = true;
+        gStripBusy      = false;
+        gStripPending   = false;
+        CRITICAL_REGION_EXIT();
+    }
+    return gStripMem.scratch;
+}
+
+// the strip comes back with a blank frame, which also returns its current to the power budget
+void stripResume(void)
+{
+    if(!gStripSuspended)
+        return;
+
+    memset(&gStripMem, 0, sizeof(gStripMem));
+    gStripSuspended = false;
+    stripCommit();
+}
@@ -0,0 +1,113 @@
+#include "wave.h"
+
+#define WAVE_CORDIC_ITER 18
+
+// 1 / prod(sqrt(1 + 2^-2i)) in Q30
+#define WAVE_CORDIC_GAIN 652032874
+
+#define WAVE_QUARTER_TURN 0x40000000UL
+
+// atan(2^-i) in turns scaled to 2^32
+static const int32_t gWaveAtan[WAVE_CORDIC_ITER] =
+{
+    536870912, 316933406, 167458907, 85004756, 42667331, 21354465,
+    10679838,  5340245,   2670163,   1335087,  667544,   333772,
+    166886,    83443,     41722,     20861,    10430,    5215
+};
+
+void waveSetup(Wave* wave, uint32_t periodMs, uint32_t tickMs)
+{
+    wave->phase = 0;
+    wave->step  = (((uint64_t)tickMs << 32) + periodMs / 2) / periodMs;
+}
+
+uint32_t waveAdvance(Wave* wave)
+{
+    uint32_t phase = wave->phase;
+    wave->phase += wave->step;
+    return phase;
+}
+
+uint32_t wavePhase(uint32_t t, uint32_t period)
+{
+    return ((uint64_t)(t % period) << 32) / period;
+}
+
+static int16_t waveQ30ToQ15(int32_t value)
+{
+    value = (value + (1 << 14)) >> 15;
+    return value > INT16_MAX ? INT16_MAX : value;
+}
+
+// rotation-mode CORDIC over the first quadrant, the others are folded by symmetry
+void waveSinCosQ15(uint32_t phase, int16_t* sinQ15, int16_t* cosQ15)
+{
+    uint8_t quadrant = phase >> 30;
+    int32_t z = phase & (WAVE_QUARTER_TURN - 1);
+    int32_t x = WAVE_CORDIC_GAIN;
+    int32_t y = 0;
+
+    for(uint8_t idx = 0; idx < WAVE_CORDIC_ITER; ++idx)
+    {
+        int32_t xShift = x >> idx;
+        int32_t yShift = y >> idx;
+        if(z >= 0)
+        {
+            x -= yShift;
+            y += xShift;
+            z -= gWaveAtan[idx];
+        }
+        else
+        {
+            x += yShift;
+            y -= xShift;
+            z += gWaveAtan[idx];
+        }
+    }
+
+    int16_t s = waveQ30ToQ15(y);
+    int16_t c = waveQ30ToQ15(x);
+
+    switch(quadrant)
+    {
+    case 0:
+        *sinQ15 = s;
+        *cosQ15 = c;
+        break;
+
+    case 1:
+        *sinQ15 = c;
+        *cosQ15 = -s;
+        break;
+
+    case 2:
+        *sinQ15 = -s;
+        *cosQ15 = -c;
+        break;
+
+    default:
+        *sinQ15 = -c;
+        *cosQ15 = s;
+        break;
+    }
+}
+
+int16_t waveSinQ15(uint32_t phase)
+{
+    int16_t sinQ15, cosQ15;
+    waveSinCosQ15(phase, &sinQ15, &cosQ15);
+    return sinQ15;
+}
+
+int16_t waveCosQ15(uint32_t phase)
+{
+    int16_t sinQ15, cosQ15;
+    waveSinCosQ15(phase, &sinQ15, &cosQ15);
+    return cosQ15;
+}
+
+// UINT8_MAX * (1 - cos) / 2, rounded
+uint8_t waveRaisedCos(uint32_t phase)
+{
+    return (UINT8_MAX * (uint32_t)(INT16_MAX + 1 - waveCosQ15(phase)) + (1 << 15)) >> 16;
+}
@@ -0,0 +1,30 @@
+#include "ws2812.h"
+#include "power.h"
+
+// kept free of SDK dependencies so the encoder can be benchmarked on a host
+
+static uint16_t* ws2812EncodeByte(uint16_t* dst, uint8_t byte)
+{
+    for(uint8_t mask = 0x80; mask != 0; mask >>= 1)
+        *dst++ = (byte & mask) ? WS2812_PWM_BIT1 : WS2812_PWM_BIT0;
+    return dst;
+}
+
+// WS2812 expects GRB order, MSB first; the power limiter scale is applied while encoding
+// so the frame itself is left intact, returns the slot past the last one written
+uint16_t* ws2812EncodePixels(uint16_t* dst, const ColorRGB* pixels, uint16_t num, uint16_t scale)
+{
+    for(uint16_t idx = 0; idx < num; ++idx)
+    {
+        dst = ws2812EncodeByte(dst, powerScale(pixels[idx].g, scale));
+        dst = ws2812EncodeByte(dst, powerScale(pixels[idx].r, scale));
+        dst = ws2812EncodeByte(dst, powerScale(pixels[idx].b, scale));
+    }
+    return dst;
+}
+
+void ws2812EncodeIdle(uint16_t* dst, const uint16_t* end)
+{
+    while(dst < end)
+        *dst++ = WS2812_PWM_IDLE;
+}
@@ -0,0 +1,112 @@
+#include "app_timer.h"
+#include "nrf_log.h"
+
+#include "macro.h"
+#include "queue.h"
+
+// steps executed back to back before the player yields; the next batch and every new pass
+// start from the timer, never from the queue directly, so a macro without delays cannot
+// refill the queue faster than the main loop drains its color events
+#define MACRO_STEPS_PER_EVENT 8
+#define MACRO_YIELD_MS        1
+
+APP_TIMER_DEF(gTimerMacroStep);
+
+static MacroStep gMacroSteps[MACRO_STEP_NUM_MAX];
+static uint8_t   gMacroStepNum  = 0;
+static uint8_t   gMacroStepIdx  = 0;
+static uint8_t   gMacroRepeats  = 0;
+static bool      gMacroRunning  = false;
+
+static void macroHandlerStep(void* p_context)
+{
+    queueEventEnqueue((Event){EventMacroStep});
+}
+
+void macroSetup(void)
+{
+    app_timer_create(&gTimerMacroStep, APP_TIMER_MODE_SINGLE_SHOT, macroHandlerStep);
+}
+
+// the macro is copied to RAM, so it may be replaced or deleted while playing;
+// repeats == 0 loops until stopped
+FlashRetCode macroStart(const char* name, uint8_t repeats)
+{
+    uint8_t      len     = sizeof(gMacroSteps);
+    FlashRetCode retCode = flashLoadMacro(name, (uint8_t*)gMacroSteps, &len);
+    if(retCode != FlashRetCodeSuccess)
+        return retCode;
+
+    app_timer_stop(gTimerMacroStep);
+    gMacroStepNum = len / sizeof(MacroStep);
+    gMacroStepIdx = 0;
+    gMacroRepeats = repeats;
+    gMacroRunning = gMacroStepNum > 0;
+
+    NRF_LOG_INFO("Macro %s started, %u steps", name, gMacroStepNum);
+    if(gMacroRunning)
+        queueEventEnqueue((Event){EventMacroStep});
+    return FlashRetCodeSuccess;
+}
+
+void macroStop(void)
+{
+    app_timer_stop(gTimerMacroStep);
+    gMacroRunning = false;
+}
+
+bool macroIsRunning(void)
+{
+    return gMacroRunning;
+}
+
+static bool macroNextStep(void)
+{
+    if(++gMacroStepIdx < gMacroStepNum)
+        return true;
+
+    gMacroStepIdx = 0;
+    if(gMacroRepeats == 0)
+        return true;
+    return --gMacroRepeats > 0;
+}
+
+// color steps are posted as regular color events, a delay step arms the timer and yields
+void macroProcessStep(void)
+{
+    for(uint8_t cnt = 0; gMacroRunning && cnt < MACRO_STEPS_PER_EVENT; ++cnt)
+    {
+        const MacroStep* step  = &gMacroSteps[gMacroStepIdx];
+        uint16_t         delay = 0;
+
+        switch(step->op)
+        {
+        case MacroOpRGB:
+            queueEventEnqueue((Event){EventChangeColorRGB, {.rgb = {.r = step->args[0], .g = step->args[1], .b = step->args[2]}}});
+            break;
+
+        case MacroOpHSV:
+            queueEventEnqueue((Event){EventChangeColorHSV, {.hsv = {.h = step->args[0], .s = step->args[1], .v = step->args[2]}}});
+            break;
+
+        case MacroOpDelay:
+            delay = step->args[0] | (step->args[1] << 8);
+            break;
+
+        default:
+            break;
+        }
+
+        gMacroRunning = macroNextStep();
+        if(gMacroRunning && delay > 0)
+        {
+            app_timer_start(gTimerMacroStep, APP_TIMER_TICKS(delay), NULL);
+            return;
+        }
+        if(gMacroStepIdx == 0)
+            break;
+    }
+
+    if(gMacroRunning)
+        app_timer_start(gTimerMacroStep, APP_TIMER_TICKS(MACRO_YIELD_MS), NULL);
+}
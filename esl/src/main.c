@@ -15,15 +15,26 @@
 #include "queue.h"
 #include "switch.h"
 #include "leds.h"
+#include "strip.h"
+#include "anim.h"
+#include "prof.h"
+#include "power.h"
 #include "flash.h"
+#include "macro.h"
 #include "cli.h"
+#include "frame.h"
 #include "stack.h"
 #include "service.h"
+#include "observer.h"
 
 #define COLOR_MOD_PERIOD_MS 10
 
 APP_TIMER_DEF(gTimerColorMod);
 
+// set by the ramp timer until the main loop has taken the step, a busy loop skips steps
+// instead of filling the queue
+static volatile bool gColorModPending = false;
+
 static Context gCtx =
 {
     .mode  = InputModeNone,
@@ -36,10 +47,24 @@ static Context gCtx =
     .ptrColorParam = NULL
 };
 
-static void modifyColorParam(void* p_context)
+static void applyColor(const Context* ctx)
 {
-    Context* ctx = (Context*)p_context;
+    if(animIsRunning())
+        animSetColor(ctx->color);
+    else
+    {
+        ledsSetLED2StateHSV(ctx->color);
+        stripFill(hsv2rgb(ctx->color));
+        stripCommit();
+    }
+    bleServiceAttrHSVNotify();
+    bleStackAdvUpdate(ctx->color, ctx->mode);
+}
 
+// one ramp step, run by the main loop so the LEDs, the strip and the SoftDevice calls
+// of applyColor never run in timer context
+static void modifyColorParam(Context* ctx)
+{
     static bool increase = true;
 
     if(*(ctx->ptrColorParam) == 0)
@@ -56,8 +81,16 @@ static void modifyColorParam(void* p_context)
     else
         --*(ctx->ptrColorParam);
 
-    ledsSetLED2StateHSV(ctx->color);
-    bleServiceAttrHSVNotify();
+    applyColor(ctx);
+}
+
+static void modifyColorParamTick(void* p_context)
+{
+    if(gColorModPending)
+        return;
+
+    gColorModPending = true;
+    queueEventEnqueue((Event){EventColorModify});
 }
 
 static void switchMode(Context* ctx)
@@ -91,6 +124,8 @@ static void switchMode(Context* ctx)
 
 static void updateState(Context* ctx)
 {
+    bleStackAdvUpdate(ctx->color, ctx->mode);
+
     switch(ctx->mode)
     {
     case InputModeNone:
@@ -123,10 +158,11 @@ int main(void)
     NRF_LOG_DEFAULT_BACKENDS_INIT();
 
     nrf_pwr_mgmt_init();
+    profSetup();
     nrfx_gpiote_init();
 
     app_timer_init();
-    app_timer_create(&gTimerColorMod, APP_TIMER_MODE_REPEATED, modifyColorParam);
+    app_timer_create(&gTimerColorMod, APP_TIMER_MODE_REPEATED, modifyColorParamTick);
 
     switchSetupGPIO();
     switchSetupGPIOTE();
@@ -139,11 +175,18 @@ int main(void)
     ledsSetupLED1Timer();
     ledsSetLED2StateHSV(gCtx.color);
 
+    stripSetup();
+    stripFill(hsv2rgb(gCtx.color));
+    stripCommit();
+
+    animSetup();
+    macroSetup();
+
     bleStackSetup();
-    bleServiceSetup();
-    bleServiceAttrHSVSetup(&gCtx.color);
+    bleServiceSetup(&gCtx.color);
     bleServiceAttrHSVNotify();
-    bleServiceAttrInputSetup(NULL);
+    bleStackAdvUpdate(gCtx.color, gCtx.mode);
+    bleObserverSetup();
 
     while(true)
     {
@@ -155,6 +198,8 @@ int main(void)
         switch(event.type)
         {
         case EventSwitchPressed:
+            // any press makes the device discoverable again
+            bleStackAdvRestart();
             switch(event.data.num)
             {
             case 1:
@@ -172,23 +217,67 @@ int main(void)
             break;
 
         case EventSwitchPressedContinuous:
-            app_timer_start(gTimerColorMod, APP_TIMER_TICKS(COLOR_MOD_PERIOD_MS), &gCtx);
+            app_timer_start(gTimerColorMod, APP_TIMER_TICKS(COLOR_MOD_PERIOD_MS), NULL);
             break;
 
         case EventSwitchReleased:
             app_timer_stop(gTimerColorMod);
             break;
 
+        case EventColorModify:
+            gColorModPending = false;
+            // a step queued just before the release or a mode change has nothing to modify
+            if(gCtx.ptrColorParam != NULL)
+                modifyColorParam(&gCtx);
+            break;
+
         case EventChangeColorRGB:
             gCtx.color = rgb2hsv(event.data.rgb);
-            ledsSetLED2StateHSV(gCtx.color);
-            bleServiceAttrHSVNotify();
+            applyColor(&gCtx);
             break;
 
         case EventChangeColorHSV:
             gCtx.color = event.data.hsv;
-            ledsSetLED2StateHSV(gCtx.color);
-            bleServiceAttrHSVNotify();
+            applyColor(&gCtx);
+            break;
+
+        case EventAnimStart:
+            animStart(event.data.anim, gCtx.color);
+            break;
+
+        case EventAnimFrame:
+            animProcessFrame();
+            break;
+
+        case EventCliLine:
+            cliExecLines();
+            break;
+
+        case EventStripCommit:
+            stripCommit();
+            break;
+
+        case EventStripPixels:
+            frameApplyPixels();
+            break;
+
+        case EventMacroStep:
+            macroProcessStep();
+            break;
+
+        case EventFadeColor:
+            bleObserverPersist();
+            if(event.data.fade.fadeMs == 0)
+            {
+                gCtx.color = event.data.fade.hsv;
+                applyColor(&gCtx);
+            }
+            else
+                animStart((AnimParams){AnimEffectFade, event.data.fade.fadeMs}, event.data.fade.hsv);
+            break;
+
+        case EventAdvPhase:
+            bleStackAdvProcess(event.data.num);
             break;
 
         default:
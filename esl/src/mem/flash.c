@@ -7,6 +7,7 @@
 #include "nrf_fstorage_sd.h"
 
 #include "nrf_log.h"
+#include "crc16.h"
 
 #include "metadata.h"
 #include "flash.h"
@@ -26,6 +27,14 @@
 #define DATA_OFFSET      4
 #define DATA_BUFFER_SIZE UINT8_MAX
 
+#define FLASH_ALIGN(len) (((len) + 3) & ~3)
+
+// page 0 keeps the latest record of each of these types
+#define FLASH_LATEST_COLOR_HSV 0
+#define FLASH_LATEST_BCAST_SEQ 1
+#define FLASH_LATEST_NUM       2
+#define FLASH_LATEST_LEN_MAX   8
+
 static const uint32_t gAppDataStartAddr[] =
 {
     APP_DATA_START_ADDR_P0,
@@ -47,17 +56,27 @@ static const Metadata gMetadataPage =
     .length = 0
 };
 
+static const Metadata gMetadataLatest[FLASH_LATEST_NUM] =
+{
+    [FLASH_LATEST_COLOR_HSV] = {.type = METADATA_TYPE_COLOR_HSV, .state = METADATA_STATE_ACTIVE, .length = FLASH_ALIGN(3)},
+    [FLASH_LATEST_BCAST_SEQ] = {.type = METADATA_TYPE_BCAST_SEQ, .state = METADATA_STATE_ACTIVE, .length = FLASH_ALIGN(4)}
+};
+
+// page image staged by flash_load in memory lent by the caller, committed with a single erase
+// and a single write
+static uint8_t* gFlashImage     = NULL;
+static uint8_t  gFlashImagePage = APP_DATA_PAGES_NUM;
+
 NRF_FSTORAGE_DEF(nrf_fstorage_t gStorage) =
 {
     .start_addr = APP_DATA_START_ADDR_P0,
     .end_addr   = APP_DATA_BEYOND
 };
 
+// fstorage writes whole words
 static uint8_t flashAlignLength(uint8_t len)
 {
-    if(len % 4 != 0)
-        len = len / 4 + 4;
-    return len;
+    return (len + 3) & ~3;
 }
 
 static void flashAwait(void)
@@ -67,7 +86,8 @@ static void flashAwait(void)
 
 static void flashMetadataWrite(uint32_t addr, Metadata meta)
 {
-    uint8_t bytes[2];
+    uint8_t bytes[DATA_OFFSET];
+    memset(bytes, 0xFF, DATA_OFFSET);
     bytes[0] = (meta.type & METADATA_MASK_TYPE) | (meta.state & METADATA_MASK_STATE);
     bytes[1] = meta.length;
 
@@ -188,6 +208,38 @@ static FlashRetCode flashRecordFindFree(uint8_t pageIdx, uint32_t* addr)
     return FlashRetCodeSuccess;
 }
 
+// records of the same type and state are told apart by the name stored at the start of their data
+static FlashRetCode flashRecordFindNamed(uint8_t pageIdx, uint32_t* addr, Metadata metaRef, const char* name)
+{
+    uint32_t addrCurr = gAppDataStartAddr[pageIdx];
+    uint32_t addrNext = flashGetNextAddr(addrCurr);
+
+    Metadata metaCurr;
+    Metadata metaNext = flashMetadataRead(addrNext);
+
+    uint8_t nameLen = strlen(name);
+
+    *addr = gAppDataStartAddr[pageIdx];
+
+    while(!metadataIsEqual(&metaNext, &gMetadataNone))
+    {
+        addrCurr = addrNext;
+        addrNext = flashGetNextAddr(addrCurr);
+
+        metaCurr = flashMetadataRead(addrCurr);
+        metaNext = flashMetadataRead(addrNext);
+
+        const uint8_t* data = (const uint8_t*)(addrCurr + DATA_OFFSET);
+        if(metadataIsCommon(&metaCurr, &metaRef) && data[0] == nameLen && memcmp(&data[1], name, nameLen) == 0)
+            *addr = addrCurr;
+    }
+
+    if(*addr > gAppDataStartAddr[pageIdx])
+        return FlashRetCodeSuccess;
+    else
+        return FlashRetCodeMetaNotFound;
+}
+
 uint32_t flashRecordCountMeta(uint8_t pageIdx, Metadata metaRef)
 {
     uint32_t addrCurr = gAppDataStartAddr[pageIdx];
@@ -213,28 +265,46 @@ uint32_t flashRecordCountMeta(uint8_t pageIdx, Metadata metaRef)
     return cntr;
 }
 
-void flashSaveColorHSV(ColorHSV hsv)
+// appends to page 0; a full page is erased and the latest record of every other type is
+// carried over, so saving the color never loses the broadcast window and the other way round
+static void flashSaveLatest(Metadata meta, const uint8_t* data)
 {
     uint32_t addr;
-    if(flashRecordFindFree(0, &addr) == FlashRetCodeBeyondPage)
+    flashRecordFindFree(0, &addr);
+    if(flashRecordWrite(0, addr, meta, data) != FlashRetCodeBeyondPage)
+        return;
+
+    uint8_t kept[FLASH_LATEST_NUM][FLASH_LATEST_LEN_MAX];
+    bool    found[FLASH_LATEST_NUM];
+    for(uint8_t idx = 0; idx < FLASH_LATEST_NUM; ++idx)
     {
-        flashPageErase(0);
-        flashRecordFindFree(0, &addr);
+        found[idx] = !metadataIsEqual(&gMetadataLatest[idx], &meta) &&
+                     flashRecordFindLastMeta(0, &addr, gMetadataLatest[idx]) == FlashRetCodeSuccess;
+        if(found[idx])
+            memcpy(kept[idx], (const uint8_t*)(addr + DATA_OFFSET), gMetadataLatest[idx].length);
     }
 
-    Metadata meta =
-    {
-        .type   = METADATA_TYPE_COLOR_HSV,
-        .state  = METADATA_STATE_ACTIVE,
-        .length = flashAlignLength(3)
-    };
+    flashPageErase(0);
+    for(uint8_t idx = 0; idx < FLASH_LATEST_NUM; ++idx)
+        if(found[idx])
+        {
+            flashRecordFindFree(0, &addr);
+            flashRecordWrite(0, addr, gMetadataLatest[idx], kept[idx]);
+        }
 
-    uint8_t data[DATA_BUFFER_SIZE];
+    flashRecordFindFree(0, &addr);
+    flashRecordWrite(0, addr, meta, data);
+}
+
+void flashSaveColorHSV(ColorHSV hsv)
+{
+    uint8_t data[FLASH_ALIGN(3)];
+    memset(data, 0xFF, sizeof(data));
     data[0] = hsv.h;
     data[1] = hsv.s;
     data[2] = hsv.v;
 
-    flashRecordWrite(0, addr, meta, data);
+    flashSaveLatest(gMetadataLatest[FLASH_LATEST_COLOR_HSV], data);
 }
 
 void flashLoadColorHSV(ColorHSV* hsv)
@@ -255,6 +325,31 @@ void flashLoadColorHSV(ColorHSV* hsv)
     }
 }
 
+// a broadcast sequence number at or past every accepted one
+void flashSaveBcastSeq(uint32_t seqMark)
+{
+    uint8_t data[FLASH_ALIGN(4)];
+    data[0] = seqMark & 0xFF;
+    data[1] = (seqMark >> 8) & 0xFF;
+    data[2] = (seqMark >> 16) & 0xFF;
+    data[3] = seqMark >> 24;
+
+    flashSaveLatest(gMetadataLatest[FLASH_LATEST_BCAST_SEQ], data);
+}
+
+FlashRetCode flashLoadBcastSeq(uint32_t* seqMark)
+{
+    uint32_t     addr;
+    FlashRetCode retCode = flashRecordFindLastMeta(0, &addr, gMetadataLatest[FLASH_LATEST_BCAST_SEQ]);
+    if(retCode == FlashRetCodeSuccess)
+    {
+        const uint8_t* data = (const uint8_t*)(addr + DATA_OFFSET);
+        *seqMark = data[0] | (data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    }
+
+    return retCode;
+}
+
 void flashSaveColorRGBNamed(ColorRGB rgb, const char* name)
 {
     uint32_t addr;
@@ -320,3 +415,219 @@ FlashRetCode flashDeleteColorRGBNamed(const char* name)
 
     return retCode;
 }
+
+FlashRetCode flashSaveMacro(const char* name, const uint8_t* steps, uint8_t len)
+{
+    uint8_t nameLen = strlen(name);
+    if(1 + nameLen + len > DATA_BUFFER_SIZE - 3)
+        return FlashRetCodeBeyondPage;
+
+    uint32_t addr;
+    flashRecordFindFree(2, &addr);
+
+    Metadata meta =
+    {
+        .type   = METADATA_TYPE_MACRO,
+        .state  = METADATA_STATE_ACTIVE,
+        .length = flashAlignLength(1 + nameLen + len)
+    };
+
+    uint8_t data[DATA_BUFFER_SIZE];
+    memset(data, 0xFF, meta.length);
+    data[0] = nameLen;
+    memcpy(&data[1], name, nameLen);
+    memcpy(&data[1 + nameLen], steps, len);
+
+    // a previous macro of that name stays on the page until the new one is written
+    uint32_t addrPrev;
+    bool     replace = flashRecordFindNamed(2, &addrPrev, meta, name) == FlashRetCodeSuccess;
+
+    FlashRetCode retCode = flashRecordWrite(2, addr, meta, data);
+    if(retCode == FlashRetCodeSuccess && replace)
+    {
+        Metadata metaPrev = flashMetadataRead(addrPrev);
+        metaPrev.state    = METADATA_STATE_DELETED;
+        flashMetadataWrite(addrPrev, metaPrev);
+    }
+
+    return retCode;
+}
+
+// len holds the capacity of steps on input; steps are returned with the padding of the record,
+// which holds erased 0xFF bytes
+FlashRetCode flashLoadMacro(const char* name, uint8_t* steps, uint8_t* len)
+{
+    Metadata meta =
+    {
+        .type  = METADATA_TYPE_MACRO,
+        .state = METADATA_STATE_ACTIVE
+    };
+
+    uint32_t addr;
+    FlashRetCode retCode = flashRecordFindNamed(2, &addr, meta, name);
+    if(retCode == FlashRetCodeSuccess)
+    {
+        meta = flashMetadataRead(addr);
+        const uint8_t* data = (const uint8_t*)(addr + DATA_OFFSET);
+        uint8_t stored = meta.length - 1 - data[0];
+        if(stored < *len)
+            *len = stored;
+        memcpy(steps, &data[1 + data[0]], *len);
+    }
+
+    return retCode;
+}
+
+FlashRetCode flashDeleteMacro(const char* name)
+{
+    Metadata meta =
+    {
+        .type  = METADATA_TYPE_MACRO,
+        .state = METADATA_STATE_ACTIVE
+    };
+
+    uint32_t addr;
+    FlashRetCode retCode = flashRecordFindNamed(2, &addr, meta, name);
+    if(retCode == FlashRetCodeSuccess)
+    {
+        meta       = flashMetadataRead(addr);
+        meta.state = METADATA_STATE_DELETED;
+        flashMetadataWrite(addr, meta);
+    }
+
+    return retCode;
+}
+
+// *addr == 0 starts at the page info record, deleted records are skipped
+FlashRetCode flashRecordNext(uint8_t pageIdx, uint32_t* addr, uint16_t* len)
+{
+    uint32_t addrEnd  = gAppDataStartAddr[pageIdx] + CODE_PAGE_SIZE;
+    uint32_t addrCurr = *addr == 0 ? gAppDataStartAddr[pageIdx] : flashGetNextAddr(*addr);
+
+    while(addrCurr + DATA_OFFSET <= addrEnd)
+    {
+        Metadata meta = flashMetadataRead(addrCurr);
+        if(metadataIsEqual(&meta, &gMetadataNone))
+            break;
+
+        if(meta.state == METADATA_STATE_ACTIVE)
+        {
+            *addr = addrCurr;
+            *len  = DATA_OFFSET + meta.length;
+            return FlashRetCodeSuccess;
+        }
+        addrCurr = flashGetNextAddr(addrCurr);
+    }
+
+    return FlashRetCodeMetaNotFound;
+}
+
+FlashRetCode flashImageBegin(uint8_t pageIdx, uint8_t* image)
+{
+    if(pageIdx >= APP_DATA_PAGES_NUM)
+        return FlashRetCodeBeyondPage;
+
+    memset(image, 0xFF, CODE_PAGE_SIZE);
+    gFlashImage     = image;
+    gFlashImagePage = pageIdx;
+    return FlashRetCodeSuccess;
+}
+
+FlashRetCode flashImageWrite(uint8_t pageIdx, uint16_t offset, const uint8_t* data, uint16_t len)
+{
+    if(pageIdx != gFlashImagePage)
+        return FlashRetCodeBadImage;
+    if(offset > CODE_PAGE_SIZE || len > CODE_PAGE_SIZE - offset)
+        return FlashRetCodeBeyondPage;
+
+    memcpy(&gFlashImage[offset], data, len);
+    return FlashRetCodeSuccess;
+}
+
+void flashImageAbort(void)
+{
+    gFlashImage     = NULL;
+    gFlashImagePage = APP_DATA_PAGES_NUM;
+}
+
+// the record types the accessors write, page info only heads a page
+static bool flashImageTypeKnown(uint8_t type)
+{
+    switch(type)
+    {
+    case METADATA_TYPE_COLOR_RGB:
+    case METADATA_TYPE_COLOR_HSV:
+    case METADATA_TYPE_COLOR_RGB_NAMED:
+    case METADATA_TYPE_COLOR_HSV_NAMED:
+    case METADATA_TYPE_MACRO:
+    case METADATA_TYPE_BCAST_SEQ:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+// walks the record chain the way the flash accessors do: the page info record comes first, every
+// record must be word aligned, of a known type and state and end within len, which it fills exactly
+static bool flashImageCheck(const uint8_t* image, uint16_t len)
+{
+    uint16_t pos = 0;
+    while(pos < len)
+    {
+        if(len - pos < DATA_OFFSET)
+            return false;
+
+        Metadata meta =
+        {
+            .type   = image[pos] & METADATA_MASK_TYPE,
+            .state  = image[pos] & METADATA_MASK_STATE,
+            .length = image[pos + 1]
+        };
+        if(pos == 0 ? !metadataIsEqual(&meta, &gMetadataPage) : meta.type == METADATA_TYPE_PAGE_INFO)
+            return false;
+        if(pos > 0 && !flashImageTypeKnown(meta.type))
+            return false;
+        if(meta.state != METADATA_STATE_ACTIVE && meta.state != METADATA_STATE_DELETED)
+            return false;
+        if(image[pos + 2] != 0xFF || image[pos + 3] != 0xFF || meta.length != flashAlignLength(meta.length))
+            return false;
+        if(DATA_OFFSET + meta.length > len - pos)
+            return false;
+        // macros store the length of their name first
+        if(meta.type == METADATA_TYPE_MACRO && (meta.length == 0 || image[pos + DATA_OFFSET] >= meta.length))
+            return false;
+
+        pos += DATA_OFFSET + meta.length;
+    }
+    return pos > 0;
+}
+
+// the image must match the CRC16 (CCITT, SDK crc16_compute) and hold a valid record chain, the page
+// is read back once written; any commit releases the staged image whatever the outcome
+FlashRetCode flashImageCommit(uint8_t pageIdx, uint16_t len, uint16_t crc)
+{
+    const uint8_t* image  = gFlashImage;
+    uint8_t        staged = gFlashImagePage;
+    flashImageAbort();
+
+    if(pageIdx != staged)
+        return FlashRetCodeBadImage;
+
+    if(len > CODE_PAGE_SIZE)
+        return FlashRetCodeBeyondPage;
+    if(crc16_compute(image, len, NULL) != crc)
+        return FlashRetCodeBadCRC;
+    if(!flashImageCheck(image, len))
+        return FlashRetCodeBadImage;
+
+    nrf_fstorage_erase(&gStorage, gAppDataStartAddr[pageIdx], 1, NULL);
+    flashAwait();
+    nrf_fstorage_write(&gStorage, gAppDataStartAddr[pageIdx], image, len, NULL);
+    flashAwait();
+
+    // the bytes past len were erased and must read back erased as well
+    if(memcmp((const void*)gAppDataStartAddr[pageIdx], image, CODE_PAGE_SIZE) != 0)
+        return FlashRetCodeBadWrite;
+    return FlashRetCodeSuccess;
+}
@@ -0,0 +1,22 @@
+#include "nrf.h"
+
+#include "prof.h"
+
+// DWT CYCCNT runs at core clock and wraps every ~67s at 64MHz,
+// unsigned differences of two samples stay valid across a single wrap
+void profSetup(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT       = 0;
+    DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t profCycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+uint32_t profCyclesToUs(uint32_t cycles)
+{
+    return cycles / (SystemCoreClock / 1000000);
+}
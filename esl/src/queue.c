@@ -1,51 +1,64 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#include "queue.h"
+#include "app_util_platform.h"
 
-#define QUEUE_SIZE UINT8_MAX
+#include "queue.h"
 
-static Event gQueue[QUEUE_SIZE];
+static Queue gQueue;
 
-static uint8_t gIdxF = 0;
-static uint8_t gIdxR = 0;
+static bool queueIsFull(const Queue* queue)
+{
+    return queue->idxR == QUEUE_SIZE;
+}
 
-static bool queueIsFull(void)
+static bool queueIsEmpty(const Queue* queue)
 {
-    return gIdxR == QUEUE_SIZE;
+    return queue->idxF == queue->idxR;
 }
 
-static bool queueIsEmpty(void)
+static void queueShift(Queue* queue)
 {
-    return gIdxF == gIdxR;
+    for(uint8_t idx = 0; idx < queue->idxR - queue->idxF; ++idx)
+        queue->events[idx] = queue->events[queue->idxF + idx];
+    queue->idxR -= queue->idxF;
+    queue->idxF -= queue->idxF;
 }
 
-static void queueShift(void)
+// producers run in USB, PWM, timer and SoftDevice interrupts of different priorities, so both
+// ends and the compaction run with interrupts masked; a shift only moves events when a producer
+// finds the queue full, draining it shifts nothing
+void queueEnqueue(Queue* queue, Event event)
 {
-    for(uint8_t idx = 0; idx < gIdxR - gIdxF; ++idx)
-        gQueue[idx] = gQueue[gIdxF + idx];
-    gIdxR -= gIdxF;
-    gIdxF -= gIdxF;
+    CRITICAL_REGION_ENTER();
+    if(queueIsFull(queue))
+        queueShift(queue);
+
+    if(!queueIsFull(queue))
+        queue->events[queue->idxR++] = event;
+    CRITICAL_REGION_EXIT();
 }
 
-void queueEventEnqueue(Event event)
+Event queueDequeue(Queue* queue)
 {
-    if(queueIsFull())
-        queueShift();
+    Event event = {EventNone};
 
-    if(queueIsFull())
-        return;
+    CRITICAL_REGION_ENTER();
+    if(queueIsEmpty(queue))
+        queueShift(queue);
+    else
+        event = queue->events[queue->idxF++];
+    CRITICAL_REGION_EXIT();
 
-    gQueue[gIdxR++] = event;
+    return event;
 }
 
-Event queueEventDequeue(void)
+void queueEventEnqueue(Event event)
 {
-    if(queueIsEmpty())
-    {
-        queueShift();
-        return (Event){EventNone};
-    }
+    queueEnqueue(&gQueue, event);
+}
 
-    return gQueue[gIdxF++];
+Event queueEventDequeue(void)
+{
+    return queueDequeue(&gQueue);
 }